@@ -0,0 +1,97 @@
+/**
+ * @file bench_chan.c
+ * @brief Throughput of a pipeline of threads connected by channels
+ *
+ * A source thread sends BENCH_MESSAGES integers through BENCH_STAGES
+ * threads, each of which receives from one channel and sends to the next,
+ * to a sink thread. We report the messages which get through the whole
+ * pipeline per second, and the context switches per message, for several
+ * channel capacities.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "chan.h"
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_MESSAGES 1000000
+#define BENCH_STAGES 8
+
+static l1_chan* chans[BENCH_STAGES + 1];
+static long sink_sum;
+
+static void* bench_source(void* arg) {
+  for (long i = 0; i < BENCH_MESSAGES; ++i)
+    l1_chan_send(chans[0], &i);
+  l1_chan_close(chans[0]);
+  return NULL;
+}
+
+static void* bench_stage(void* arg) {
+  long stage = (long)arg;
+  long value;
+  bool ok;
+
+  while (l1_chan_recv(chans[stage], &value, &ok) == SUCCESS && ok)
+    l1_chan_send(chans[stage + 1], &value);
+  l1_chan_close(chans[stage + 1]);
+  return NULL;
+}
+
+static void* bench_sink(void* arg) {
+  long value;
+  bool ok;
+
+  while (l1_chan_recv(chans[BENCH_STAGES], &value, &ok) == SUCCESS && ok)
+    sink_sum += value;
+  return NULL;
+}
+
+static void bench_run(size_t capacity) {
+  struct timespec start, end;
+  l1_tid tid;
+
+  sink_sum = 0;
+  initialize_scheduler(l1_round_robin_policy);
+  for (int i = 0; i <= BENCH_STAGES; ++i) {
+    if (l1_chan_create(&chans[i], sizeof(long), capacity) != SUCCESS)
+      exit(EXIT_FAILURE);
+  }
+  l1_thread_create(&tid, bench_source, NULL);
+  for (long i = 0; i < BENCH_STAGES; ++i)
+    l1_thread_create(&tid, bench_stage, (void*)i);
+  l1_thread_create(&tid, bench_sink, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (sink_sum != (long)BENCH_MESSAGES * (BENCH_MESSAGES - 1) / 2) {
+    fprintf(stderr, "Messages were lost!\n");
+    exit(EXIT_FAILURE);
+  }
+  double s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("capacity %4zu %6.2f M messages/s %7.2f switches/message\n", capacity,
+         BENCH_MESSAGES / s / 1e6, (double)get_scheduler()->switches / BENCH_MESSAGES);
+  clean_up_scheduler();
+  for (int i = 0; i <= BENCH_STAGES; ++i)
+    l1_chan_free(chans[i]);
+}
+
+int main(int argc, char **argv)
+{
+  size_t capacities[] = { 0, 1, 16, 256 };
+
+  for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); ++i)
+    bench_run(capacities[i]);
+
+  return EXIT_SUCCESS;
+}
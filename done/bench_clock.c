@@ -0,0 +1,128 @@
+/**
+ * @file bench_clock.c
+ * @brief Cost of the clock reads of the scheduler
+ *
+ * Measures the time of one read of each clock, then a direct-switch
+ * ping-pong with each source of `l1_time_get`, which the scheduler reads
+ * twice per switch to account slices.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "l1_time.h"
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_READS 10000000
+#define BENCH_YIELDS 1000000
+
+static l1_tid players[2];
+/* Keeps the reads from being optimized out */
+static volatile uint64_t sink;
+
+static void read_time(void) {
+  sink += time(NULL);
+}
+
+static void read_monotonic(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  sink += ts.tv_nsec;
+}
+
+static void read_coarse(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  sink += ts.tv_nsec;
+}
+
+static void read_rdtsc(void) {
+  unsigned int lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  sink += lo;
+}
+
+static void read_l1_time(void) {
+  l1_time t;
+
+  l1_time_get(&t);
+  sink += t;
+}
+
+static double elapsed_ns(struct timespec* start, struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void bench_read(const char* name, void (*read)(void)) {
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCH_READS; ++i)
+    read();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("read %-22s %8.1f ns/read\n", name, elapsed_ns(&start, &end) / BENCH_READS);
+}
+
+static void* bench_player(void* arg) {
+  int me = (int)(long)arg;
+
+  for (int i = 0; i < BENCH_YIELDS; ++i)
+    yield(players[1 - me]);
+  return NULL;
+}
+
+static void bench_yield(const char* name) {
+  struct timespec start, end;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&players[0], bench_player, (void*)0L);
+  l1_thread_create(&players[1], bench_player, (void*)1L);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("yield with %-16s %8.1f ns/yield\n", name, elapsed_ns(&start, &end) / (2.0 * BENCH_YIELDS));
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  bool tsc = l1_time_get_source() == L1_TIME_TSC;
+  l1_time start_tsc, end_tsc;
+  uint64_t start_ns = l1_time_now_ns();
+
+  l1_time_get(&start_tsc);
+  bench_read("time()", read_time);
+  bench_read("CLOCK_MONOTONIC", read_monotonic);
+  bench_read("CLOCK_MONOTONIC_COARSE", read_coarse);
+  bench_read("rdtsc", read_rdtsc);
+  if (tsc) {
+    bench_read("l1_time_get (TSC)", read_l1_time);
+    bench_yield("TSC");
+  } else {
+    printf("no invariant TSC\n");
+  }
+  l1_time_set_source(L1_TIME_MONOTONIC);
+  bench_read("l1_time_get (MONOTONIC)", read_l1_time);
+  bench_yield("CLOCK_MONOTONIC");
+
+  if (tsc) {
+    /* Error of the calibration over the whole run */
+    l1_time_set_source(L1_TIME_TSC);
+    l1_time_get(&end_tsc);
+    double run_ns = l1_time_now_ns() - start_ns;
+    double drift_ns = (double)(end_tsc - start_tsc) - run_ns;
+    printf("TSC drift %.0f ns over %.2f s (%.1f ppm)\n", drift_ns, run_ns / 1e9, drift_ns / run_ns * 1e6);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file bench_coro.c
+ * @brief Generator benchmark: coroutine against thread-plus-join
+ *
+ * A consumer thread sums the values of a generator. With coroutines, the
+ * generator yields each value to the consumer. With threads, the consumer
+ * creates a thread per value and joins it to get the value, which is how
+ * an iterator has to be written with only l1_thread_create and
+ * l1_thread_join. We report the time per generated value.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "coro.h"
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_VALUES 200000
+
+static long bench_sum;
+
+static void* coro_generator(void* arg) {
+  for (long i = 0; i < BENCH_VALUES; ++i)
+    l1_coro_yield((void*)i);
+  return NULL;
+}
+
+static void* coro_consumer(void* arg) {
+  l1_coro* gen;
+  void* value;
+
+  if (l1_coro_create(&gen, coro_generator, NULL) != SUCCESS)
+    return NULL;
+  while (l1_coro_resume(gen, &value) == SUCCESS && !l1_coro_done(gen))
+    bench_sum += (long)value;
+  l1_coro_free(gen);
+  return NULL;
+}
+
+static void* thread_generator(void* arg) {
+  return arg;
+}
+
+static void* thread_consumer(void* arg) {
+  l1_tid gen;
+  void* value;
+
+  for (long i = 0; i < BENCH_VALUES; ++i) {
+    if (l1_thread_create(&gen, thread_generator, (void*)i) != SUCCESS ||
+        l1_thread_join(gen, &value) != SUCCESS)
+      return NULL;
+    bench_sum += (long)value;
+  }
+  return NULL;
+}
+
+static void bench_run(const char* name, void* (*consumer)(void*)) {
+  struct timespec start, end;
+  l1_tid tid;
+
+  bench_sum = 0;
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&tid, consumer, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf("%-14s %8.1f ns/value %s\n", name, ns / BENCH_VALUES,
+         bench_sum == (long)BENCH_VALUES * (BENCH_VALUES - 1) / 2 ? "" : "(wrong sum)");
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  bench_run("coroutine", coro_consumer);
+  bench_run("thread+join", thread_consumer);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file bench_echo.c
+ * @brief Loopback echo server on the I/O reactor
+ *
+ * One thread accepts connections and starts an echo thread for each of
+ * them. Client threads, one per connection, send requests of
+ * BENCH_MSG_SIZE bytes and wait for the echo. Everything runs on the one
+ * OS thread, so the latency includes waiting for the other threads.
+ *
+ * A connection takes two fds in this process, so the number of
+ * connections is capped by RLIMIT_NOFILE.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "io.h"
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_CONNECTIONS 10000
+#define BENCH_REQUESTS 10
+#define BENCH_MSG_SIZE 64
+/* fds besides the connections: stdio, listener, epoll */
+#define BENCH_SPARE_FDS 16
+
+static long bench_connections;
+static int bench_listener;
+static struct sockaddr_in bench_addr;
+static uint64_t* bench_latencies;
+static long bench_failures;
+
+static uint64_t bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Reads or writes exactly count bytes */
+static int bench_transfer(int fd, char* buf, size_t count, bool write) {
+  for (size_t done = 0; done < count;) {
+    ssize_t n = write ? l1_write(fd, buf + done, count - done)
+                      : l1_read(fd, buf + done, count - done);
+    if (n <= 0)
+      return -1;
+    done += n;
+  }
+  return 0;
+}
+
+static void* bench_echo(void* arg) {
+  int fd = (int)(long)arg;
+  char buf[BENCH_MSG_SIZE];
+  ssize_t n;
+
+  while ((n = l1_read(fd, buf, sizeof(buf))) > 0) {
+    if (bench_transfer(fd, buf, n, true) < 0)
+      break;
+  }
+  close(fd);
+  return NULL;
+}
+
+static void* bench_acceptor(void* arg) {
+  l1_tid tid;
+
+  for (long i = 0; i < bench_connections; ++i) {
+    int fd = l1_accept(bench_listener, NULL, NULL);
+
+    if (fd < 0 || l1_thread_create(&tid, bench_echo, (void*)(long)fd) != SUCCESS) {
+      perror("accept");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return NULL;
+}
+
+static void* bench_client(void* arg) {
+  long id = (long)arg;
+  char buf[BENCH_MSG_SIZE] = { 0 };
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+  if (fd < 0 || l1_connect(fd, (struct sockaddr*)&bench_addr, sizeof(bench_addr)) < 0) {
+    bench_failures++;
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  for (int i = 0; i < BENCH_REQUESTS; ++i) {
+    uint64_t start = bench_now();
+
+    if (bench_transfer(fd, buf, sizeof(buf), true) < 0 ||
+        bench_transfer(fd, buf, sizeof(buf), false) < 0) {
+      bench_failures++;
+      break;
+    }
+    bench_latencies[id * BENCH_REQUESTS + i] = bench_now() - start;
+  }
+  close(fd);
+  return NULL;
+}
+
+static int bench_compare(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+  struct rlimit limit;
+  socklen_t len = sizeof(bench_addr);
+  l1_tid tid;
+
+  /* Use as many fds as allowed */
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  getrlimit(RLIMIT_NOFILE, &limit);
+  bench_connections = ((long)limit.rlim_cur - BENCH_SPARE_FDS) / 2;
+  if (bench_connections > BENCH_CONNECTIONS)
+    bench_connections = BENCH_CONNECTIONS;
+
+  bench_latencies = calloc(bench_connections * BENCH_REQUESTS, sizeof(uint64_t));
+  bench_addr.sin_family = AF_INET;
+  bench_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bench_listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (!bench_latencies || bench_listener < 0 ||
+      bind(bench_listener, (struct sockaddr*)&bench_addr, sizeof(bench_addr)) < 0 ||
+      listen(bench_listener, bench_connections) < 0 ||
+      getsockname(bench_listener, (struct sockaddr*)&bench_addr, &len) < 0) {
+    perror("listen");
+    return EXIT_FAILURE;
+  }
+
+  initialize_scheduler(l1_round_robin_policy);
+  if (l1_thread_create(&tid, bench_acceptor, NULL) != SUCCESS)
+    return EXIT_FAILURE;
+  for (long i = 0; i < bench_connections; ++i) {
+    if (l1_thread_create(&tid, bench_client, (void*)i) != SUCCESS)
+      return EXIT_FAILURE;
+  }
+
+  uint64_t start = bench_now();
+  schedule();
+  double s = (bench_now() - start) / 1e9;
+  clean_up_scheduler();
+  close(bench_listener);
+
+  long requests = bench_connections * BENCH_REQUESTS;
+  qsort(bench_latencies, requests, sizeof(uint64_t), bench_compare);
+  printf("%ld connections %ld requests %10.0f requests/s p50 %8.1f us p99 %8.1f us "
+         "%ld failures\n", bench_connections, requests, requests / s,
+         bench_latencies[requests / 2] / 1e3, bench_latencies[requests * 99 / 100] / 1e3,
+         bench_failures);
+  free(bench_latencies);
+
+  return EXIT_SUCCESS;
+}
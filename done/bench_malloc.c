@@ -0,0 +1,87 @@
+/**
+ * @file bench_malloc.c
+ * @brief Benchmark of the tiered allocator against each of its tiers
+ *
+ * Every allocator runs the same random mix of small objects and page-sized
+ * buffers over a fixed number of live slots. For each allocator we report
+ * the average time per malloc/free pair and the number of failed requests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "malloc.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_SLOTS 32
+#define BENCH_ITERATIONS 200000
+/* One request in BENCH_LARGE_RATIO is page-sized */
+#define BENCH_LARGE_RATIO 10
+
+typedef struct {
+  const char *name;
+  void (*init)(void);
+  void (*deinit)(void);
+  void *(*malloc)(size_t);
+  l1_error (*free)(void *);
+} bench_alloc8r;
+
+static const bench_alloc8r alloc8rs[] = {
+  {"listoc8r", l1_listoc8r_init, l1_listoc8r_deinit, l1_listoc8r_malloc, l1_listoc8r_free},
+  {"slab", l1_slab_init, l1_slab_deinit, l1_slab_malloc, l1_slab_free},
+  {"chunk", l1_chunk_init, l1_chunk_deinit, l1_chunk_malloc, l1_chunk_free},
+  {"tiered", l1_tiered_init, l1_tiered_deinit, l1_tiered_malloc, l1_tiered_free},
+};
+
+static size_t bench_request_size(void) {
+  if (rand() % BENCH_LARGE_RATIO == 0)
+    return CHUNK_SIZE * (1 + rand() % 4);
+  return 16 + rand() % 496;
+}
+
+static void bench_run(const bench_alloc8r *a) {
+  void *slots[BENCH_SLOTS] = { NULL };
+  unsigned long failed = 0;
+  struct timespec start, end;
+
+  l1_init = a->init;
+  l1_deinit = a->deinit;
+  l1_malloc = a->malloc;
+  l1_free = a->free;
+
+  l1_init();
+  /* Same request sequence for every allocator */
+  srand(42);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned long i = 0; i < BENCH_ITERATIONS; ++i) {
+    unsigned slot = rand() % BENCH_SLOTS;
+    l1_free(slots[slot]);
+    slots[slot] = l1_malloc(bench_request_size());
+    if (slots[slot] == NULL)
+      ++failed;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (unsigned i = 0; i < BENCH_SLOTS; ++i)
+    l1_free(slots[i]);
+  l1_deinit();
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf("%-10s %10.1f ns/op %10lu failed\n", a->name, ns / BENCH_ITERATIONS, failed);
+}
+
+int main(int argc, char **argv)
+{
+  /* The allocators report every failed request on stderr */
+  if (freopen("/dev/null", "w", stderr) == NULL)
+    return EXIT_FAILURE;
+
+  for (unsigned i = 0; i < sizeof(alloc8rs) / sizeof(alloc8rs[0]); ++i)
+    bench_run(&alloc8rs[i]);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file bench_mn.c
+ * @brief Fork-join throughput of the M:N scheduler against the workers
+ *
+ * A binary tree of threads is spawned recursively: every inner thread
+ * creates and joins two children, every leaf does a fixed amount of work.
+ * The same tree runs with 1 worker up to one worker per online core.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "malloc.h"
+#include "sched_mn.h"
+#include "schedule.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_DEPTH 14
+#define BENCH_LEAF_WORK 20000
+
+static void* bench_node(void* arg) {
+  long depth = (long)arg;
+  l1_tid children[2];
+  void* results[2];
+
+  if (depth == 0) {
+    volatile unsigned long x = 0;
+    for (long i = 0; i < BENCH_LEAF_WORK; ++i)
+      x += i;
+    return (void*)1L;
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (l1_thread_create(&children[i], bench_node, (void*)(depth - 1)) != SUCCESS)
+      exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (l1_thread_join(children[i], &results[i]) != SUCCESS)
+      exit(EXIT_FAILURE);
+  }
+  return (void*)((long)results[0] + (long)results[1] + 1);
+}
+
+static void bench_run(unsigned workers, double* base) {
+  struct timespec start, end;
+  uint64_t steals = 0;
+  l1_tid tid;
+
+  if (l1_mn_init(workers) != SUCCESS ||
+      l1_thread_create(&tid, bench_node, (void*)(long)BENCH_DEPTH) != SUCCESS)
+    exit(EXIT_FAILURE);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  l1_mn_schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (unsigned i = 0; i < workers; ++i)
+    steals += l1_mn_worker(i)->steals;
+  l1_mn_clean_up();
+
+  double s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  long tasks = (2L << BENCH_DEPTH) - 1;
+  if (workers == 1)
+    *base = s;
+  printf("%3u workers %10.0f threads/s %6.2fx speedup %8lu steals\n", workers,
+         tasks / s, *base / s, (unsigned long)steals);
+}
+
+int main(int argc, char **argv)
+{
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  double base = 0;
+
+  if (cores < 1)
+    cores = 1;
+  for (unsigned workers = 1; workers <= cores; ++workers)
+    bench_run(workers, &base);
+
+  return EXIT_SUCCESS;
+}
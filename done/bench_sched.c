@@ -0,0 +1,82 @@
+/**
+ * @file bench_sched.c
+ * @brief Scheduling cost against the number of runnable threads
+ *
+ * N threads keep yielding to the scheduler policy, for increasing N. The
+ * total number of yields is fixed, so a policy whose cost does not depend
+ * on the number of runnable threads shows a constant time per yield.
+ *
+ * The threads run on the shared stack: with a private stack each, 100k
+ * threads would exceed the default limit on the number of mappings.
+ * Segmented stacks cannot be shared, so that mode stops at 10k threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_YIELDS 1000000
+#define BENCH_MIN_ROUNDS 10
+#ifdef L1_SPLIT_STACK
+#define BENCH_MAX_THREADS 10000
+#define bench_thread_create l1_thread_create
+#else
+#define BENCH_MAX_THREADS 100000
+#define bench_thread_create l1_thread_create_shared
+#endif
+
+static long bench_rounds;
+
+static void* bench_yielder(void* arg) {
+  for (long i = 0; i < bench_rounds; ++i)
+    yield(-1);
+  return NULL;
+}
+
+static void bench_run(const char* name, sched_policy policy, long threads) {
+  struct timespec start, end;
+  l1_tid tid;
+
+  bench_rounds = BENCH_YIELDS / threads;
+  if (bench_rounds < BENCH_MIN_ROUNDS)
+    bench_rounds = BENCH_MIN_ROUNDS;
+
+  initialize_scheduler(policy);
+  for (long i = 0; i < threads; ++i) {
+    if (bench_thread_create(&tid, bench_yielder, NULL) != SUCCESS)
+      exit(EXIT_FAILURE);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf("%-16s %7ld threads %8.1f ns/yield\n", name, threads,
+         ns / (threads * bench_rounds));
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  for (long threads = 10; threads <= BENCH_MAX_THREADS; threads *= 10)
+    bench_run("round robin", l1_round_robin_policy, threads);
+  for (long threads = 10; threads <= BENCH_MAX_THREADS; threads *= 10)
+    bench_run("mlfq", l1_mlfq_policy, threads);
+  for (long threads = 10; threads <= BENCH_MAX_THREADS; threads *= 10)
+    bench_run("smallest cycles", l1_smallest_cycles_policy, threads);
+  for (long threads = 10; threads <= BENCH_MAX_THREADS; threads *= 10)
+    bench_run("stride", l1_stride_policy, threads);
+  for (long threads = 10; threads <= BENCH_MAX_THREADS; threads *= 10)
+    bench_run("cfs", l1_cfs_policy, threads);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file bench_stack_copy.c
+ * @brief Benchmark of shared-stack threads against private-stack threads
+ *
+ * Every thread recurses to a fixed depth and then yields in a loop, so that
+ * all threads are alive with a live stack at the same time. For each mode we
+ * report the time per yield and the RSS added per thread. Each mode runs in
+ * its own process so their memory use does not mix.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_THREADS 2000
+#define BENCH_YIELDS  100
+/* Stack depth of every thread: BENCH_DEPTH frames of BENCH_FRAME bytes */
+#define BENCH_DEPTH   8
+#define BENCH_FRAME   128
+
+typedef l1_error (*bench_create)(l1_tid *, void *(*)(void *), void *);
+
+static long rss_sample_kib;
+/* Results go there, stdout is silenced in the benchmark processes */
+static FILE* bench_out;
+
+/* Returns the VmRSS of the process in KiB, or 0 if unknown */
+static long rss_kib(void) {
+  FILE* status = fopen("/proc/self/status", "r");
+  char line[128];
+  long rss = 0;
+
+  if (status == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), status) != NULL) {
+    if (strncmp(line, "VmRSS:", 6) == 0) {
+      rss = strtol(line + 6, NULL, 10);
+      break;
+    }
+  }
+  fclose(status);
+  return rss;
+}
+
+static int bench_recurse(int depth) {
+  volatile char frame[BENCH_FRAME];
+  frame[0] = 1;
+  if (depth == 0) {
+    for (int i = 0; i < BENCH_YIELDS; ++i)
+      yield(-1);
+    return frame[0];
+  }
+  return bench_recurse(depth - 1) + frame[0];
+}
+
+static void* bench_worker(void* arg) {
+  bench_recurse(BENCH_DEPTH);
+  return NULL;
+}
+
+static void* bench_parent(void* arg) {
+  static l1_tid workers[BENCH_THREADS];
+  bench_create create = *(bench_create*)arg;
+
+  for (int i = 0; i < BENCH_THREADS; ++i) {
+    if (create(&workers[i], bench_worker, NULL) != SUCCESS)
+      exit(EXIT_FAILURE);
+  }
+  /* After one round, every worker is parked at full depth */
+  yield(-1);
+  rss_sample_kib = rss_kib();
+  for (int i = 0; i < BENCH_THREADS; ++i)
+    l1_thread_join(workers[i], NULL);
+  return NULL;
+}
+
+static void bench_run(const char* name, bench_create create) {
+  struct timespec start, end;
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  long rss_base = rss_kib();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  l1_thread_create(&parent, bench_parent, &create);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  clean_up_scheduler();
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  fprintf(bench_out, "%-8s %8.1f ns/yield %8.2f KiB/thread\n", name,
+         ns / ((double)BENCH_THREADS * BENCH_YIELDS),
+         (double)(rss_sample_kib - rss_base) / BENCH_THREADS);
+}
+
+int main(int argc, char **argv)
+{
+  const char* names[] = { "private", "shared" };
+  bench_create creates[] = { l1_thread_create, l1_thread_create_shared };
+
+  for (int i = 0; i < 2; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      /* The scheduler prints when it terminates */
+      bench_out = fdopen(dup(STDOUT_FILENO), "w");
+      if (bench_out == NULL || freopen("/dev/null", "w", stdout) == NULL)
+        exit(EXIT_FAILURE);
+      bench_run(names[i], creates[i]);
+      fclose(bench_out);
+      exit(EXIT_SUCCESS);
+    }
+    waitpid(pid, NULL, 0);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file bench_switch.c
+ * @brief Cycle cost of the raw context switch routines
+ *
+ * Main ping-pongs with a single context on an l1_stack, without the
+ * scheduler in between, and we report the rdtsc cycles per switch of
+ * switch_asm and switch_asm_fp.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+#include "malloc.h"
+#include "schedule.h"
+#include "stack.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_SWITCHES 1000000
+
+static void (*bench_switch_fn)(uint64_t*, uint64_t**);
+static l1_stack main_stack;
+static l1_stack* peer_stack;
+
+static void bench_peer(void) {
+  for (;;)
+    bench_switch_fn(main_stack.top, &peer_stack->top);
+}
+
+static void bench_run(const char* name, void (*fn)(uint64_t*, uint64_t**),
+                      bool fp_frame) {
+  bench_switch_fn = fn;
+  peer_stack = l1_stack_new();
+
+  /* Same initial frame as l1_thread_create, see switch.S */
+  l1_stack_push(peer_stack, 0);
+  l1_stack_push(peer_stack, (uint64_t)&bench_peer);
+  l1_stack_push(peer_stack, (uint64_t)peer_stack->base);  // %rbp
+  for (int i = 0; i < 5; ++i)
+    l1_stack_push(peer_stack, 0);  // %r15 .. %rbx
+  if (fp_frame)
+    l1_stack_push(peer_stack, SWITCH_FP_DEFAULT_CONTROL);
+
+  uint64_t start = __rdtsc();
+  for (int i = 0; i < BENCH_SWITCHES; ++i)
+    fn(peer_stack->top, &main_stack.top);
+  uint64_t end = __rdtsc();
+
+  printf("%-14s %6.1f cycles/switch\n", name,
+         (double)(end - start) / (2.0 * BENCH_SWITCHES));
+  l1_stack_free(peer_stack);
+}
+
+int main(int argc, char **argv)
+{
+  bench_run("switch_asm", switch_asm, false);
+  bench_run("switch_asm_fp", switch_asm_fp, true);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file bench_sync.c
+ * @brief Contention benchmarks of the synchronization objects against
+ * yield-spinning
+ *
+ * lock: N threads take turns in a critical section which yields once in
+ * the middle, as if it waited for something. Waiting threads either spin
+ * with yield until the lock is free, or wait on a l1_mutex.
+ *
+ * ring: N threads pass a token around, in the reverse order of their
+ * creation so that the ring does not follow the round-robin order. Each
+ * thread either spins with yield until the token is its own, or waits on
+ * its own l1_sem which the previous thread posts.
+ *
+ * "handoff" objects also switch to the woken thread. We report the time
+ * and context switches per critical section or token pass.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "sync.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_OPS 200000
+#define BENCH_MAX_THREADS 200
+
+typedef enum { SPIN, BLOCK, HANDOFF } bench_mode;
+static const char* bench_mode_names[] = { "yield-spin", "blocking", "handoff" };
+
+static bench_mode mode;
+static long rounds;
+static bool spin_locked;
+static l1_mutex mutex;
+static long token;
+static long threads;
+static l1_sem sems[BENCH_MAX_THREADS];
+
+static void* bench_locker(void* arg) {
+  for (long i = 0; i < rounds; ++i) {
+    if (mode == SPIN) {
+      while (spin_locked)
+        yield(-1);
+      spin_locked = true;
+    } else {
+      l1_mutex_lock(&mutex);
+    }
+    yield(-1);
+    if (mode == SPIN) {
+      spin_locked = false;
+    } else {
+      l1_mutex_unlock(&mutex);
+    }
+  }
+  return NULL;
+}
+
+static void* bench_ring(void* arg) {
+  long me = (long)arg;
+
+  for (long i = 0; i < rounds; ++i) {
+    if (mode == SPIN) {
+      while (token != me)
+        yield(-1);
+      token = (me + threads - 1) % threads;
+    } else {
+      l1_sem_wait(&sems[me]);
+      l1_sem_post(&sems[(me + threads - 1) % threads]);
+    }
+  }
+  return NULL;
+}
+
+static void bench_run(const char* name, void* (*func)(void*), long n) {
+  struct timespec start, end;
+  l1_tid tid;
+
+  threads = n;
+  rounds = BENCH_OPS / n;
+  spin_locked = false;
+  token = 0;
+  initialize_scheduler(l1_round_robin_policy);
+  l1_mutex_init(&mutex, mode == HANDOFF);
+  for (long i = 0; i < n; ++i)
+    l1_sem_init(&sems[i], i == 0, mode == HANDOFF);
+  for (long i = 0; i < n; ++i) {
+    if (l1_thread_create(&tid, func, (void*)i) != SUCCESS)
+      exit(EXIT_FAILURE);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  double ops = (double)rounds * n;
+  printf("%-5s %-10s %5ld threads %10.1f ns/op %8.2f switches/op\n", name,
+         bench_mode_names[mode], n, ns / ops, get_scheduler()->switches / ops);
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  for (long n = 2; n <= BENCH_MAX_THREADS; n *= 10) {
+    for (mode = SPIN; mode <= HANDOFF; ++mode)
+      bench_run("lock", bench_locker, n);
+  }
+  for (long n = 2; n <= BENCH_MAX_THREADS; n *= 10) {
+    for (mode = SPIN; mode <= HANDOFF; ++mode)
+      bench_run("ring", bench_ring, n);
+  }
+
+  return EXIT_SUCCESS;
+}
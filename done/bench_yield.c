@@ -0,0 +1,65 @@
+/**
+ * @file bench_yield.c
+ * @brief Ping-pong benchmark of direct thread-to-thread switches
+ *
+ * Two threads yield to each other a fixed number of times, with and without
+ * direct switches, and with direct switches traced (see trace.h). For each
+ * mode we report the time and the number of context switches per yield.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+
+#define BENCH_YIELDS 1000000
+/* Events kept when traced */
+#define BENCH_TRACE_EVENTS 65536
+
+static l1_tid players[2];
+
+static void* bench_player(void* arg) {
+  int me = (int)(long)arg;
+
+  for (int i = 0; i < BENCH_YIELDS; ++i)
+    yield(players[1 - me]);
+  return NULL;
+}
+
+static void bench_run(const char* name, bool direct_switch, bool traced) {
+  struct timespec start, end;
+
+  initialize_scheduler(l1_round_robin_policy);
+  get_scheduler()->direct_switch = direct_switch;
+  if (traced) {
+    l1_trace_start(BENCH_TRACE_EVENTS);
+  }
+  l1_thread_create(&players[0], bench_player, (void*)0L);
+  l1_thread_create(&players[1], bench_player, (void*)1L);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  schedule();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf("%-8s %8.1f ns/yield %6.2f switches/yield\n", name,
+         ns / (2.0 * BENCH_YIELDS),
+         (double)get_scheduler()->switches / (2.0 * BENCH_YIELDS));
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  bench_run("via tsys", false, false);
+  bench_run("direct", true, false);
+  bench_run("traced", true, true);
+
+  return EXIT_SUCCESS;
+}
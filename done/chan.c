@@ -0,0 +1,294 @@
+/**
+ * @file chan.c
+ * @brief Implementation of the channels
+ */
+#include <stdio.h>
+#include <string.h>
+#include "chan.h"
+#include "malloc.h"
+#include "schedule.h"
+
+/* A thread waiting on the cases of a select, on its stack or on the heap */
+typedef struct l1_chan_wait {
+  l1_thread_info* thread;       /* Waiting thread */
+  l1_chan_waiter* waiters;      /* One per case */
+  size_t n;                     /* Number of cases */
+  size_t chosen;                /* Case which was done */
+  bool ok;                      /* ok of that case */
+} l1_chan_wait;
+
+/* Turn of the cases of l1_chan_select which can be done at once */
+static size_t select_turn;
+
+l1_error l1_chan_create(l1_chan** chan, size_t elem_size, size_t capacity) {
+  l1_chan* new_chan = libc_malloc(sizeof(l1_chan) + elem_size * capacity);
+
+  if (!new_chan) {
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_chan_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  memset(new_chan, 0, sizeof(l1_chan));
+  new_chan->elem_size = elem_size;
+  new_chan->capacity = capacity;
+  *chan = new_chan;
+  return SUCCESS;
+}
+
+void l1_chan_free(l1_chan* chan) {
+  libc_free(chan);
+}
+
+static l1_chan_queue* queue_of(l1_chan_waiter* waiter) {
+  return waiter->dir == L1_CHAN_SEND ? &waiter->chan->senders : &waiter->chan->receivers;
+}
+
+static void queue_add(l1_chan_waiter* waiter) {
+  l1_chan_queue* queue = queue_of(waiter);
+
+  waiter->prev = queue->tail;
+  waiter->next = NULL;
+  if (queue->tail) {
+    queue->tail->next = waiter;
+  } else {
+    queue->head = waiter;
+  }
+  queue->tail = waiter;
+  waiter->queued = true;
+}
+
+static void queue_remove(l1_chan_waiter* waiter) {
+  l1_chan_queue* queue = queue_of(waiter);
+
+  if (waiter->prev) {
+    waiter->prev->next = waiter->next;
+  } else {
+    queue->head = waiter->next;
+  }
+  if (waiter->next) {
+    waiter->next->prev = waiter->prev;
+  } else {
+    queue->tail = waiter->prev;
+  }
+  waiter->prev = waiter->next = NULL;
+  waiter->queued = false;
+}
+
+/* The operation of waiter was done: its thread leaves the queues of its
+ * other cases, and wakes up */
+static void waiter_done(l1_chan_waiter* waiter, bool ok) {
+  l1_chan_wait* wait = waiter->wait;
+
+  for (size_t i = 0; i < wait->n; ++i) {
+    if (wait->waiters[i].queued) {
+      queue_remove(&wait->waiters[i]);
+    }
+  }
+  wait->chosen = waiter->index;
+  wait->ok = ok;
+  wake_thread(wait->thread);
+}
+
+/* i-th oldest element of the buffer */
+static char* chan_slot(l1_chan* chan, size_t i) {
+  return chan->buffer + (chan->head + i) % chan->capacity * chan->elem_size;
+}
+
+static bool try_send(l1_chan* chan, const void* elem, bool* ok) {
+  l1_chan_waiter* receiver = chan->receivers.head;
+
+  *ok = false;
+  if (chan->closed) {
+    return true;
+  }
+  if (receiver) {
+    /* Straight to the stack of the receiver */
+    queue_remove(receiver);
+    memcpy(receiver->elem, elem, chan->elem_size);
+    waiter_done(receiver, true);
+  } else if (chan->count < chan->capacity) {
+    memcpy(chan_slot(chan, chan->count), elem, chan->elem_size);
+    chan->count++;
+  } else {
+    return false;
+  }
+  *ok = true;
+  return true;
+}
+
+static bool try_recv(l1_chan* chan, void* elem, bool* ok) {
+  l1_chan_waiter* sender = chan->senders.head;
+
+  *ok = true;
+  if (chan->count > 0) {
+    memcpy(elem, chan_slot(chan, 0), chan->elem_size);
+    chan->head = (chan->head + 1) % chan->capacity;
+    chan->count--;
+    /* Senders only wait while the buffer is full: the first one takes the
+     * slot which was freed */
+    if (sender) {
+      queue_remove(sender);
+      memcpy(chan_slot(chan, chan->count), sender->elem, chan->elem_size);
+      chan->count++;
+      waiter_done(sender, true);
+    }
+  } else if (sender) {
+    /* Straight from the stack of the sender */
+    queue_remove(sender);
+    memcpy(elem, sender->elem, chan->elem_size);
+    waiter_done(sender, true);
+  } else if (chan->closed) {
+    memset(elem, 0, chan->elem_size);
+    *ok = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool try_case(l1_chan_case* c) {
+  return c->dir == L1_CHAN_SEND ? try_send(c->chan, c->elem, &c->ok)
+                                : try_recv(c->chan, c->elem, &c->ok);
+}
+
+/* l1_chan_select, errors are reported for fn */
+static int chan_select(l1_chan_case* cases, size_t n, bool nonblock, const char* fn) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  if (n == 1) {
+    if (try_case(&cases[0])) {
+      return 0;
+    }
+  } else if (n > 1) {
+    size_t start = select_turn++ % n;
+
+    for (size_t k = 0; k < n; ++k) {
+      size_t i = (start + k) % n;
+
+      if (try_case(&cases[i])) {
+        return i;
+      }
+    }
+  }
+  if (nonblock) {
+    return -1;
+  }
+  /* M:N workers do not park WAITING threads */
+  if (n == 0 || !sched_info || sched_info->current == sched_info->tsys || sched_info->worker) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "%s(): errno %d %s\n", fn, l1_errno, l1_strerror(l1_errno));
+    return -1;
+  }
+
+  /* Wait in the queues of all the cases. Another thread moves the stack of
+   * a shared-stack thread while it waits, so its records and elements are
+   * staged on the heap instead. */
+  bool staged = sched_info->current->thread_stack->shared != NULL;
+  l1_chan_waiter stack_waiters[staged ? 1 : n];
+  l1_chan_wait stack_wait;
+  l1_chan_wait* wait = &stack_wait;
+  char* staging = NULL;
+
+  if (staged) {
+    size_t bytes = sizeof(l1_chan_wait) + n * sizeof(l1_chan_waiter);
+
+    for (size_t i = 0; i < n; ++i)
+      bytes += cases[i].chan->elem_size;
+    wait = libc_malloc(bytes);
+    if (!wait) {
+      l1_errno = ERRNOMEM;
+      fprintf(stderr, "%s(): errno %d %s\n", fn, l1_errno, l1_strerror(l1_errno));
+      return -1;
+    }
+    wait->waiters = (l1_chan_waiter*)(wait + 1);
+    staging = (char*)(wait->waiters + n);
+  } else {
+    wait->waiters = stack_waiters;
+  }
+  wait->thread = sched_info->current;
+  wait->n = n;
+  wait->chosen = 0;
+  wait->ok = false;
+
+  for (size_t i = 0; i < n; ++i) {
+    l1_chan_waiter* waiter = &wait->waiters[i];
+
+    waiter->wait = wait;
+    waiter->chan = cases[i].chan;
+    waiter->dir = cases[i].dir;
+    waiter->index = i;
+    waiter->elem = cases[i].elem;
+    if (staged) {
+      waiter->elem = staging;
+      if (cases[i].dir == L1_CHAN_SEND) {
+        memcpy(staging, cases[i].elem, cases[i].chan->elem_size);
+      }
+      staging += cases[i].chan->elem_size;
+    }
+    queue_add(waiter);
+  }
+  wait->thread->state = WAITING;
+  yield(-1);
+
+  /* The thread which woke us up did the operation */
+  size_t chosen = wait->chosen;
+
+  cases[chosen].ok = wait->ok;
+  if (staged) {
+    if (cases[chosen].dir == L1_CHAN_RECV) {
+      memcpy(cases[chosen].elem, wait->waiters[chosen].elem, cases[chosen].chan->elem_size);
+    }
+    libc_free(wait);
+  }
+  return chosen;
+}
+
+int l1_chan_select(l1_chan_case* cases, size_t n, bool nonblock) {
+  return chan_select(cases, n, nonblock, "l1_chan_select");
+}
+
+l1_error l1_chan_send(l1_chan* chan, const void* elem) {
+  l1_chan_case send = { chan, L1_CHAN_SEND, (void*)elem, false };
+
+  if (chan_select(&send, 1, false, "l1_chan_send") < 0) {
+    return l1_errno;
+  }
+  if (!send.ok) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_chan_send(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  return SUCCESS;
+}
+
+l1_error l1_chan_recv(l1_chan* chan, void* elem, bool* ok) {
+  l1_chan_case recv = { chan, L1_CHAN_RECV, elem, false };
+
+  if (chan_select(&recv, 1, false, "l1_chan_recv") < 0) {
+    return l1_errno;
+  }
+  if (ok) *ok = recv.ok;
+  return SUCCESS;
+}
+
+l1_error l1_chan_close(l1_chan* chan) {
+  l1_chan_waiter* waiter;
+
+  if (chan->closed) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_chan_close(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  chan->closed = true;
+  /* The buffer is empty if receivers wait */
+  while ((waiter = chan->receivers.head) != NULL) {
+    queue_remove(waiter);
+    memset(waiter->elem, 0, chan->elem_size);
+    waiter_done(waiter, false);
+  }
+  while ((waiter = chan->senders.head) != NULL) {
+    queue_remove(waiter);
+    waiter_done(waiter, false);
+  }
+  return SUCCESS;
+}
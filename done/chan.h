@@ -0,0 +1,138 @@
+/**
+ * @file chan.h
+ * @brief Bounded channels between green threads, in the style of Go
+ *
+ * A channel carries elements of a fixed size. A buffered channel keeps up
+ * to capacity elements in a ring buffer; an unbuffered one (capacity 0)
+ * only passes an element from a sender to a receiver which meet.
+ *
+ * Threads which cannot send or receive wait in the WAITING state, in the
+ * queue of senders or receivers of the channel. Each wait is a
+ * l1_chan_waiter on the stack of the waiting thread, which points to the
+ * element to send or to the place to receive into: the thread which
+ * completes the operation copies the element straight from one stack to
+ * the other. A shared-stack thread's stack moves while it waits: its
+ * waiters and elements are staged on the heap, and it copies a received
+ * element to its stack when it wakes up. A thread in `l1_chan_select` waits in the queues of all the
+ * channels of its cases at once, and leaves all of them when one case is
+ * done.
+ *
+ * Closing a channel wakes up all its waiters. Receivers first get the
+ * elements left in the buffer, then a zeroed element and ok set to false.
+ * Sending on a closed channel fails (ERRINVAL).
+ *
+ * Waiting needs a green thread: in tsys or before `schedule`, a call which
+ * would block fails with ERRINVAL. So does it in M:N mode, where workers do
+ * not park waiting threads; channels are not safe across workers either,
+ * so only the calls which do not wait are of use there.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "error.h"
+#include "thread_info.h"
+
+typedef enum {
+  L1_CHAN_SEND,                 /* Send the element */
+  L1_CHAN_RECV,                 /* Receive into the element */
+} l1_chan_dir;
+
+/**
+ * @brief A case of `l1_chan_select`
+ */
+typedef struct {
+  struct l1_chan* chan;         /** Channel of the operation */
+  l1_chan_dir dir;              /** Operation */
+  void* elem;                   /** Element to send, or where to receive */
+  bool ok;                      /** Set if the case is chosen: false if the channel was closed */
+} l1_chan_case;
+
+struct l1_chan_wait;
+
+/**
+ * @brief A thread waiting for one operation on a channel
+ */
+typedef struct l1_chan_waiter {
+  struct l1_chan_wait* wait;    /** Wait of the thread, for all its cases */
+  struct l1_chan* chan;         /** Channel waited on */
+  l1_chan_dir dir;              /** Operation waited for */
+  size_t index;                 /** Case of the select */
+  void* elem;                   /** Element to send, or where to receive */
+  bool queued;                  /** In the queue of chan */
+  struct l1_chan_waiter* prev;  /** Previous waiter in the same queue */
+  struct l1_chan_waiter* next;  /** Next waiter in the same queue */
+} l1_chan_waiter;
+
+typedef struct {
+  l1_chan_waiter* head;         /** First waiter, served first */
+  l1_chan_waiter* tail;         /** Last waiter */
+} l1_chan_queue;
+
+typedef struct l1_chan {
+  size_t elem_size;             /** Size of an element in bytes */
+  size_t capacity;              /** Number of elements the buffer holds */
+  size_t head;                  /** Index of the oldest buffered element */
+  size_t count;                 /** Number of buffered elements */
+  bool closed;                  /** No more sends */
+  l1_chan_queue senders;        /** Threads waiting to send */
+  l1_chan_queue receivers;      /** Threads waiting to receive */
+  char buffer[];                /** Ring buffer of capacity elements */
+} l1_chan;
+
+/**
+ * @brief Creates a channel of elements of elem_size bytes, which buffers
+ * up to capacity of them
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code
+ *          and the contents of *chan are undefined.
+ */
+l1_error l1_chan_create(l1_chan** chan, size_t elem_size, size_t capacity);
+
+/**
+ * @brief Frees a channel, which no thread may be waiting on
+ */
+void l1_chan_free(l1_chan* chan);
+
+/**
+ * @brief Sends the element of elem_size bytes pointed to by elem, waiting
+ * for room in the buffer or for a receiver
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the channel is or gets closed, or if the thread cannot wait;
+ * ERRNOMEM if a shared-stack thread cannot stage its wait.
+ */
+l1_error l1_chan_send(l1_chan* chan, const void* elem);
+
+/**
+ * @brief Receives an element into elem, waiting for one
+ *
+ * If `ok` is not NULL, it is set to false if the channel is closed and
+ * empty; elem is then zeroed.
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the thread cannot wait; ERRNOMEM if a shared-stack thread
+ * cannot stage its wait.
+ */
+l1_error l1_chan_recv(l1_chan* chan, void* elem, bool* ok);
+
+/**
+ * @brief Closes the channel, and wakes up all the threads waiting on it
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the channel is already closed.
+ */
+l1_error l1_chan_close(l1_chan* chan);
+
+/**
+ * @brief Does one of the operations of cases, waiting until one can be
+ * done unless nonblock is set
+ *
+ * If several cases can be done at once, they get their turn in rotation.
+ * A send on a closed channel can be done, with ok set to false.
+ *
+ * @return  The index of the case which was done. If nonblock is set, -1 if
+ *          none could be done without waiting. Otherwise, -1 on error, with
+ *          l1_errno set: ERRINVAL if the thread cannot wait; ERRNOMEM if a
+ *          shared-stack thread cannot stage its wait.
+ */
+int l1_chan_select(l1_chan_case* cases, size_t n, bool nonblock);
@@ -0,0 +1,119 @@
+/**
+ * @file coro.c
+ * @brief Asymmetric coroutines on l1_stacks
+ */
+#include <stdlib.h>
+#include "coro.h"
+#include "malloc.h"
+#include "schedule.h"
+
+/* Coroutine running outside of any green thread */
+static L1_THREAD_LOCAL l1_coro* coro_outside = NULL;
+
+/* Where the running coroutine of the current green thread is kept */
+static l1_coro** coro_current(void) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  if (sched_info && sched_info->current) {
+    return &sched_info->current->coro;
+  }
+  return &coro_outside;
+}
+
+/* First frame of every coroutine, like l1_start for threads */
+static void l1_coro_start(void) {
+  l1_coro* coro = *coro_current();
+
+  coro->value = coro->func(coro->arg);
+  coro->done = true;
+  /* Never resumed again */
+  switch_stack(&coro->caller, coro->stack);
+}
+
+l1_error l1_coro_create(l1_coro** coro, void* (*func)(void*), void* arg) {
+  l1_coro* new_coro = libc_malloc(sizeof(l1_coro));
+
+  if (!new_coro) {
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_coro_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  new_coro->stack = l1_stack_new();
+  if (!new_coro->stack) {
+    libc_free(new_coro);
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_coro_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  new_coro->resumer = NULL;
+  new_coro->func = func;
+  new_coro->arg = arg;
+  new_coro->value = NULL;
+  new_coro->running = false;
+  new_coro->done = false;
+
+  /* Same initial frame as a new thread, see switch.S */
+  l1_stack_push(new_coro->stack, 0);
+  l1_stack_push(new_coro->stack, (uint64_t)&l1_coro_start);
+  l1_stack_push(new_coro->stack, (uint64_t)new_coro->stack->base);  // %rbp
+  l1_stack_push(new_coro->stack, 0);  // %r15
+  l1_stack_push(new_coro->stack, 0);  // %r14
+  l1_stack_push(new_coro->stack, 0);  // %r13
+  l1_stack_push(new_coro->stack, 0);  // %r12
+  l1_stack_push(new_coro->stack, 0);  // %rbx
+#ifdef L1_SWITCH_FP
+  l1_stack_push(new_coro->stack, SWITCH_FP_DEFAULT_CONTROL);  // MXCSR, x87 CW
+#endif
+
+  *coro = new_coro;
+  return SUCCESS;
+}
+
+l1_error l1_coro_resume(l1_coro* coro, void** value) {
+  if (!coro || coro->running || coro->done) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_coro_resume(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  l1_coro** current = coro_current();
+
+  coro->resumer = *current;
+  coro->running = true;
+  *current = coro;
+  switch_stack(coro->stack, &coro->caller);
+  /* Back from l1_coro_yield or l1_coro_start */
+  *current = coro->resumer;
+  coro->resumer = NULL;
+  coro->running = false;
+
+  if (value) *value = coro->value;
+  return SUCCESS;
+}
+
+l1_error l1_coro_yield(void* value) {
+  l1_coro* coro = *coro_current();
+
+  if (!coro) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_coro_yield(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  coro->value = value;
+  switch_stack(&coro->caller, coro->stack);
+  return SUCCESS;
+}
+
+bool l1_coro_done(l1_coro* coro) {
+  return coro->done;
+}
+
+void l1_coro_free(l1_coro* coro) {
+  if (!coro || coro->running) {
+    return;
+  }
+  l1_stack_free(coro->stack);
+  libc_free(coro);
+}
@@ -0,0 +1,80 @@
+/**
+ * @file coro.h
+ * @brief Asymmetric coroutines
+ *
+ * A coroutine runs a function on its own l1_stack. `l1_coro_resume` switches
+ * from the caller straight to the coroutine, and `l1_coro_yield` straight
+ * back to whoever resumed it, without going through the scheduler. This
+ * makes generators much cheaper than a thread per value.
+ *
+ * A coroutine belongs to the green thread that resumes it, and coroutines
+ * can be used before the scheduler is initialized or after it terminated.
+ *
+ * @warning The function of a coroutine resumed by a shared-stack thread must
+ * not yield or join, since the thread is then not running on its stack.
+ */
+#pragma once
+#include <stdbool.h>
+#include "error.h"
+#include "stack.h"
+
+typedef struct l1_coro {
+  l1_stack* stack;              /** Coroutine stack */
+  l1_stack caller;              /** Context of the resumer while the coroutine runs */
+  struct l1_coro* resumer;      /** Coroutine which resumed this one, NULL if none */
+  void* (*func)(void*);         /** Function run by the coroutine */
+  void* arg;                    /** Function arg */
+  void* value;                  /** Last value yielded or returned */
+  bool running;                 /** The coroutine is resumed */
+  bool done;                    /** The function returned */
+} l1_coro;
+
+/**
+ * @brief Creates a coroutine, suspended before the first line of func
+ *
+ * @param  coro   Where to put the new coroutine
+ * @param  func   Function run by the coroutine on its first resume
+ * @param  arg    Argument of func
+ * @return  If successful, return SUCCESS. On error, it returns an error code
+ *          and the contents of *coro are undefined.
+ */
+l1_error l1_coro_create(l1_coro** coro, void* (*func)(void*), void* arg);
+
+/**
+ * @brief Runs a coroutine until it yields or returns
+ *
+ * If `value` is not NULL, the value passed to `l1_coro_yield`, or the
+ * return value of the coroutine function, is put into it.
+ *
+ * Possible errors are resuming a coroutine which is already running, or
+ * which has finished (ERRINVAL).
+ *
+ * @param  coro     The coroutine to resume
+ * @param  value    Where to put the yielded value
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_coro_resume(l1_coro* coro, void** value);
+
+/**
+ * @brief Suspends the running coroutine and returns value to its resumer
+ *
+ * The coroutine continues from this point at its next `l1_coro_resume`.
+ *
+ * A possible error is calling it outside of a coroutine (ERRINVAL).
+ *
+ * @param  value    The value returned to the resumer
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_coro_yield(void* value);
+
+/**
+ * @brief Tells whether the coroutine function has returned
+ */
+bool l1_coro_done(l1_coro* coro);
+
+/**
+ * @brief Frees a coroutine which is not running
+ *
+ * A suspended coroutine may be freed, its function then never finishes.
+ */
+void l1_coro_free(l1_coro* coro);
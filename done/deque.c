@@ -0,0 +1,111 @@
+/**
+ * @file deque.c
+ * @brief Implementation of the work-stealing deque
+ */
+#include <stdlib.h>
+#include "deque.h"
+
+static l1_deque_array* deque_array_new(int64_t size, l1_deque_array* prev) {
+  l1_deque_array* array = malloc(sizeof(l1_deque_array) + size * sizeof(array->slots[0]));
+
+  if (array) {
+    array->size = size;
+    array->prev = prev;
+  }
+  return array;
+}
+
+l1_error deque_init(l1_deque* deque) {
+  l1_deque_array* array = deque_array_new(DEQUE_INITIAL_SIZE, NULL);
+
+  if (!array) {
+    return ERRNOMEM;
+  }
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  atomic_init(&deque->array, array);
+  return SUCCESS;
+}
+
+void deque_free(l1_deque* deque) {
+  l1_deque_array* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+  while (array) {
+    l1_deque_array* prev = array->prev;
+    free(array);
+    array = prev;
+  }
+  atomic_store_explicit(&deque->array, NULL, memory_order_relaxed);
+}
+
+l1_error deque_push(l1_deque* deque, l1_thread_info* thread) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  l1_deque_array* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+  if (b - t > array->size - 1) {
+    /* Full: copy the live slots into an array twice as large */
+    l1_deque_array* grown = deque_array_new(2 * array->size, array);
+
+    if (!grown) {
+      return ERRNOMEM;
+    }
+    for (int64_t i = t; i < b; ++i) {
+      l1_thread_info* slot = atomic_load_explicit(&array->slots[i & (array->size - 1)],
+                                                  memory_order_relaxed);
+      atomic_store_explicit(&grown->slots[i & (grown->size - 1)], slot, memory_order_relaxed);
+    }
+    atomic_store_explicit(&deque->array, grown, memory_order_release);
+    array = grown;
+  }
+  atomic_store_explicit(&array->slots[b & (array->size - 1)], thread, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  return SUCCESS;
+}
+
+l1_thread_info* deque_take(l1_deque* deque) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  l1_deque_array* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+  l1_thread_info* thread = NULL;
+
+  atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if (t <= b) {
+    thread = atomic_load_explicit(&array->slots[b & (array->size - 1)], memory_order_relaxed);
+    if (t == b) {
+      /* Last thread: race against the thieves for it */
+      if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                   memory_order_seq_cst,
+                                                   memory_order_relaxed)) {
+        thread = NULL;
+      }
+      atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  }
+  return thread;
+}
+
+l1_thread_info* deque_steal(l1_deque* deque) {
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if (t >= b) {
+    return NULL;
+  }
+  l1_deque_array* array = atomic_load_explicit(&deque->array, memory_order_acquire);
+  l1_thread_info* thread = atomic_load_explicit(&array->slots[t & (array->size - 1)],
+                                                memory_order_relaxed);
+
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return NULL;
+  }
+  return thread;
+}
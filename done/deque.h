@@ -0,0 +1,65 @@
+/**
+ * @file deque.h
+ * @brief Chase-Lev work-stealing deque of threads
+ *
+ * The owner worker pushes and takes threads at the bottom, without locks.
+ * Other workers steal the oldest thread from the top with a CAS. The
+ * circular array grows when it is full; replaced arrays are only freed with
+ * the deque, since thieves may still be reading them.
+ *
+ * Memory orderings follow Lê, Pop, Cohen and Zappa Nardelli, "Correct and
+ * efficient work-stealing for weak memory models", PPoPP 2013.
+ */
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+#include "error.h"
+#include "thread_info.h"
+
+#define DEQUE_INITIAL_SIZE 64
+
+typedef struct l1_deque_array {
+  int64_t size;                         /** Number of slots, a power of two */
+  struct l1_deque_array* prev;          /** Array this one replaced */
+  _Atomic(l1_thread_info*) slots[];     /** Circular buffer */
+} l1_deque_array;
+
+typedef struct {
+  _Atomic int64_t top;                  /** Next slot to steal from */
+  _Atomic int64_t bottom;               /** Next slot to push to */
+  _Atomic(l1_deque_array*) array;       /** Current array */
+} l1_deque;
+
+/**
+ * @brief Initializes an empty deque
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error deque_init(l1_deque* deque);
+
+/**
+ * @brief Frees the memory of the deque
+ */
+void deque_free(l1_deque* deque);
+
+/**
+ * @brief Pushes a thread at the bottom, owner only
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error deque_push(l1_deque* deque, l1_thread_info* thread);
+
+/**
+ * @brief Takes the newest thread from the bottom, owner only
+ *
+ * @return The thread, NULL if the deque is empty
+ */
+l1_thread_info* deque_take(l1_deque* deque);
+
+/**
+ * @brief Steals the oldest thread from the top, from any worker
+ *
+ * @return The thread, NULL if the deque is empty or another worker won the
+ * race for that thread
+ */
+l1_thread_info* deque_steal(l1_deque* deque);
@@ -7,12 +7,13 @@
 #include "error.h"
 
 /* Global declaration of error variable */
-l1_error l1_errno = SUCCESS;
+L1_THREAD_LOCAL l1_error l1_errno = SUCCESS;
 
 const char *error_strings[] = {
     "SUCCESS",
     "Out of memory",
     "Invalid argument",
+    "Timed out",
     "Example error",
     "Error code out of bounds"
 };
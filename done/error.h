@@ -10,15 +10,20 @@ typedef enum {
     SUCCESS = 0,
     ERRNOMEM,
     ERRINVAL,
+    ERRTIMEDOUT,
     EXAMPLE_ERROR,
     MAX_ERROR,
 } l1_error;
 
+/* Per-OS-thread variable, for state which M:N workers must not share.
+ * The library is loaded at startup, so the cheap initial-exec model works */
+#define L1_THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+
 /* Global variable for holding error number.
  * Similar to errno available by using `errno.h`
  * Holds the condition that caused error for certain
  * functions */
-extern l1_error l1_errno;
+extern L1_THREAD_LOCAL l1_error l1_errno;
 
 /**
  * @brief Returns a human-readable description of error condition
@@ -0,0 +1,136 @@
+/**
+ * @file io.c
+ * @brief Implementation of socket I/O on the reactor
+ */
+#define _GNU_SOURCE
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "io.h"
+#include "reactor.h"
+#include "schedule.h"
+#include "timer_wheel.h"
+/* After thread_info.h, whose errno field the errno macro would rename */
+#include <errno.h>
+
+/* Blocks the OS thread, when no other green thread can run meanwhile */
+static l1_error wait_fd_os(int fd, uint32_t events, int timeout) {
+  /* EPOLLIN, EPOLLOUT... have the values of POLLIN, POLLOUT... */
+  struct pollfd pfd = { .fd = fd, .events = events };
+  int n;
+
+  do {
+    n = poll(&pfd, 1, timeout);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0 || (pfd.revents & POLLNVAL)) {
+    return ERRINVAL;
+  }
+  return n == 0 ? ERRTIMEDOUT : SUCCESS;
+}
+
+l1_error l1_wait_fd(int fd, uint32_t events, int timeout) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  l1_error err;
+
+  if (!sched_info || sched_info->current == sched_info->tsys ||
+      sched_info->worker || timeout == 0) {
+    err = wait_fd_os(fd, events, timeout);
+  } else {
+    l1_thread_info* current = sched_info->current;
+
+    err = reactor_add(&sched_info->reactor, current, fd, events);
+    if (err == SUCCESS) {
+      if (timeout > 0) {
+        timer_wheel_add(&sched_info->timers, current,
+                        l1_time_now_ns() + timeout * 1000000ULL);
+      }
+      /* Woken up by the scheduler when fd is ready or the deadline passed */
+      current->state = IO_WAIT;
+      yield(-1);
+      err = current->io_events ? SUCCESS : ERRTIMEDOUT;
+    }
+  }
+
+  /* A timeout is an expected outcome, not worth a message */
+  if (err != SUCCESS) {
+    l1_errno = err;
+    if (err != ERRTIMEDOUT) {
+      fprintf(stderr, "l1_wait_fd(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    }
+  }
+  return err;
+}
+
+/* Sets errno for a failed wait, returns -1 */
+static int wait_failed(l1_error err) {
+  errno = err == ERRNOMEM ? ENOMEM : EINVAL;
+  return -1;
+}
+
+ssize_t l1_read(int fd, void* buf, size_t count) {
+  for (;;) {
+    ssize_t n = read(fd, buf, count);
+
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return n;
+    }
+    l1_error err = l1_wait_fd(fd, EPOLLIN, -1);
+    if (err != SUCCESS) {
+      return wait_failed(err);
+    }
+  }
+}
+
+ssize_t l1_write(int fd, const void* buf, size_t count) {
+  for (;;) {
+    ssize_t n = write(fd, buf, count);
+
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return n;
+    }
+    l1_error err = l1_wait_fd(fd, EPOLLOUT, -1);
+    if (err != SUCCESS) {
+      return wait_failed(err);
+    }
+  }
+}
+
+int l1_accept(int fd, struct sockaddr* addr, socklen_t* addrlen) {
+  for (;;) {
+    int conn = accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (conn >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return conn;
+    }
+    l1_error err = l1_wait_fd(fd, EPOLLIN, -1);
+    if (err != SUCCESS) {
+      return wait_failed(err);
+    }
+  }
+}
+
+int l1_connect(int fd, const struct sockaddr* addr, socklen_t addrlen) {
+  int so_error = 0;
+  socklen_t len = sizeof(so_error);
+
+  if (connect(fd, addr, addrlen) == 0) {
+    return 0;
+  }
+  if (errno != EINPROGRESS) {
+    return -1;
+  }
+  l1_error err = l1_wait_fd(fd, EPOLLOUT, -1);
+  if (err != SUCCESS) {
+    return wait_failed(err);
+  }
+  /* The outcome of the connection */
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0) {
+    return -1;
+  }
+  if (so_error) {
+    errno = so_error;
+    return -1;
+  }
+  return 0;
+}
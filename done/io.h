@@ -0,0 +1,49 @@
+/**
+ * @file io.h
+ * @brief Socket I/O which blocks the calling green thread, not the OS thread
+ *
+ * The functions behave like their libc counterparts on non-blocking fds,
+ * except that where those fail with EAGAIN, the calling thread waits in
+ * the IO_WAIT state until the fd is ready, and other threads run meanwhile.
+ * Fds which are not set O_NONBLOCK block the OS thread as usual.
+ *
+ * Only one thread may wait on an fd at a time. Outside of a green thread,
+ * and in M:N mode, waiting blocks the OS thread with poll(2).
+ */
+#pragma once
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "error.h"
+
+/**
+ * @brief Waits until fd is ready for events (EPOLLIN, EPOLLOUT), or until
+ * timeout ms passed. A negative timeout waits forever.
+ *
+ * @return  SUCCESS if fd is ready, or has an error or hang up to report.
+ * ERRTIMEDOUT if the timeout passed first, without printing an error. On
+ * error, it returns an error code.
+ */
+l1_error l1_wait_fd(int fd, uint32_t events, int timeout);
+
+/**
+ * @brief read(2), waiting for fd to be readable
+ */
+ssize_t l1_read(int fd, void* buf, size_t count);
+
+/**
+ * @brief write(2), waiting for fd to be writable
+ */
+ssize_t l1_write(int fd, const void* buf, size_t count);
+
+/**
+ * @brief accept(2), waiting for a connection. The new socket is non-blocking.
+ */
+int l1_accept(int fd, struct sockaddr* addr, socklen_t* addrlen);
+
+/**
+ * @brief connect(2) of a non-blocking socket, waiting for the connection to
+ * complete
+ */
+int l1_connect(int fd, const struct sockaddr* addr, socklen_t addrlen);
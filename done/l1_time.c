@@ -1,31 +1,113 @@
 /**
- * @brief Implementations for time in rdtsc and unix time
+ * @brief Implementations for time in rdtsc and CLOCK_MONOTONIC
  *
  * @author Adrien Ghosn, Mark Sutherland
  */
+#include <cpuid.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <time.h>
 #include "l1_time.h"
 
+/* TSC cycles are converted with ns = (cycles * mult) >> TSC_SHIFT */
+#define TSC_SHIFT 32
+__extension__ typedef unsigned __int128 l1_uint128;
+/* Calibration window */
+#define TSC_CALIBRATION_NS (10 * L1_TIME_MS)
+
+static struct {
+  l1_time_source source;        /** Source l1_time_get reads */
+  bool tsc_invariant;           /** The CPU has an invariant TSC */
+  uint64_t tsc_base;            /** TSC at base_ns */
+  uint64_t base_ns;             /** CLOCK_MONOTONIC time at tsc_base */
+  uint64_t mult;                /** ns per cycle, fixed point */
+} l1_clock;
+
+static pthread_once_t l1_clock_once = PTHREAD_ONCE_INIT;
+
+static uint64_t rdtsc(void) {
+  unsigned int lo, hi;
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t l1_time_now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Measures the TSC frequency against CLOCK_MONOTONIC, once per process */
+static void l1_clock_calibrate(void) {
+  unsigned int eax, ebx, ecx, edx;
+
+  /* Invariant TSC: CPUID.80000007H:EDX[8] */
+  l1_clock.tsc_invariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+                           (edx & (1u << 8));
+  if (!l1_clock.tsc_invariant) {
+    l1_clock.source = L1_TIME_MONOTONIC;
+    return;
+  }
+
+  uint64_t start_ns = l1_time_now_ns();
+  uint64_t start_tsc = rdtsc();
+  uint64_t end_ns, end_tsc;
+
+  do {
+    end_ns = l1_time_now_ns();
+    end_tsc = rdtsc();
+  } while (end_ns - start_ns < TSC_CALIBRATION_NS);
+
+  l1_clock.mult = ((end_ns - start_ns) << TSC_SHIFT) / (end_tsc - start_tsc);
+  l1_clock.tsc_base = end_tsc;
+  l1_clock.base_ns = end_ns;
+  l1_clock.source = L1_TIME_TSC;
+}
+
+l1_time_source l1_time_get_source(void) {
+  pthread_once(&l1_clock_once, l1_clock_calibrate);
+  return l1_clock.source;
+}
+
+l1_error l1_time_set_source(l1_time_source source) {
+  pthread_once(&l1_clock_once, l1_clock_calibrate);
+  if (source == L1_TIME_TSC && !l1_clock.tsc_invariant) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_time_set_source(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  l1_clock.source = source;
+  return SUCCESS;
+}
 
 void l1_time_init(l1_time* t) {
   *t = 0;
 }
-  
+
 void l1_time_get(l1_time* t) {
-#ifdef USE_UNIX_TIME
-    time(t);
-#else
-  unsigned int lo, hi; 
-  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
-  *t = ((uint64_t)hi << 32) | lo;
-#endif
+  /* The source starts as L1_TIME_TSC, uncalibrated */
+  if (l1_clock.mult == 0 && l1_clock.source == L1_TIME_TSC) {
+    pthread_once(&l1_clock_once, l1_clock_calibrate);
+  }
+  if (l1_clock.source == L1_TIME_TSC) {
+    /* Cycles before the base read on another CPU count as 0 */
+    uint64_t cycles = rdtsc() - l1_clock.tsc_base;
+
+    if ((int64_t)cycles < 0) cycles = 0;
+    *t = l1_clock.base_ns +
+         (uint64_t)(((l1_uint128)cycles * l1_clock.mult) >> TSC_SHIFT);
+  } else {
+    *t = l1_time_now_ns();
+  }
 }
 
 void l1_time_diff(l1_time* result, l1_time end, l1_time start) {
    if (end < start) {
-    *result = 1; 
+    *result = 0;
     return;
-   } 
+   }
    *result = end - start;
 }
 
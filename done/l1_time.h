@@ -1,20 +1,47 @@
 /**
  * @brief provides the definitions for real time in lab1.
  *
+ * Scheduling times are in ns. They are read from the invariant TSC when the
+ * CPU has one, converted to ns with a factor calibrated against
+ * CLOCK_MONOTONIC on first use, and from CLOCK_MONOTONIC otherwise.
+ *
  * @author Adrien Ghosn, Mark Sutherland
  */
 #pragma once
 #include <stdint.h>
 #include <time.h>
+#include "error.h"
 
-#define USE_UNIX_TIME
-
-/* Definition of time type */
-#ifdef USE_UNIX_TIME
-typedef time_t l1_time;
-#else
+/* Definition of time type, in ns */
 typedef uint64_t l1_time;
-#endif
+
+#define L1_TIME_US ((l1_time)1000)
+#define L1_TIME_MS ((l1_time)1000000)
+#define L1_TIME_S ((l1_time)1000000000)
+
+typedef enum {
+  L1_TIME_TSC,                  /* Invariant TSC, calibrated */
+  L1_TIME_MONOTONIC,            /* clock_gettime(CLOCK_MONOTONIC) */
+} l1_time_source;
+
+/**
+ * @brief Returns the CLOCK_MONOTONIC time in ns, for deadlines
+ */
+uint64_t l1_time_now_ns(void);
+
+/**
+ * @brief Returns the source `l1_time_get` reads, calibrating the TSC if it
+ * was not yet
+ */
+l1_time_source l1_time_get_source(void);
+
+/**
+ * @brief Makes `l1_time_get` read the given source
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ *          ERRINVAL for L1_TIME_TSC if the TSC of the CPU is not invariant
+ */
+l1_error l1_time_set_source(l1_time_source source);
 
 /**
  * @brief initializes time variable
@@ -22,12 +49,13 @@ typedef uint64_t l1_time;
 void l1_time_init(l1_time* t);
 
 /**
- * @brief puts the current time in t.
+ * @brief puts the current time in t, in ns.
  */
  void l1_time_get(l1_time* t);
 
 /**
- * @brief Puts the time difference between start and end in result.
+ * @brief Puts the time difference between start and end in result, 0 if
+ * end is before start.
  */
 void l1_time_diff(l1_time* result, l1_time end, l1_time start);
 
@@ -36,7 +64,7 @@ void l1_time_diff(l1_time* result, l1_time end, l1_time start);
  */
 void l1_time_add(l1_time* accumulator, l1_time delta);
 
-/** 
+/**
  * @brief return 1 if a < b, 0 if a >= b
  */
 int l1_time_is_smaller(l1_time a, l1_time b);
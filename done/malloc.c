@@ -12,14 +12,24 @@
 #include <math.h>
 #include "malloc.h"
 #include "error.h"
+#include "preempt.h"
+
+/* The allocators are critical sections of the runtime for preemption, see
+ * preempt.h */
 
 /*********************** Standard GLIBC malloc ***********/
 void *libc_malloc(size_t size) {
-  return malloc(size);
+  l1_critical_enter();
+  void *ptr = malloc(size);
+  l1_critical_exit_runtime();
+
+  return ptr;
 }
 
 l1_error libc_free(void *ptr) {
+  l1_critical_enter();
   free(ptr);
+  l1_critical_exit_runtime();
 
   return SUCCESS;
 }
@@ -76,7 +86,7 @@ int l1_chunk_find_contiguous_chunks(size_t chunk_num) {
   return -1;
 }
 
-void *l1_chunk_malloc(size_t size)
+static void *chunk_malloc(size_t size)
 {
   if (size == 0)
     return NULL;
@@ -113,7 +123,14 @@ void *l1_chunk_malloc(size_t size)
   return (void *)((char *)hdr_ptr + CHUNK_SIZE);
 }
 
-l1_error l1_chunk_free(void *ptr)
+void *l1_chunk_malloc(size_t size) {
+  l1_critical_enter();
+  void *ptr = chunk_malloc(size);
+  l1_critical_exit_runtime();
+  return ptr;
+}
+
+static l1_error chunk_free(void *ptr)
 {
   if (ptr == NULL)
     return SUCCESS;
@@ -148,6 +165,13 @@ l1_error l1_chunk_free(void *ptr)
 
   return SUCCESS;
 }
+
+l1_error l1_chunk_free(void *ptr) {
+  l1_critical_enter();
+  l1_error err = chunk_free(ptr);
+  l1_critical_exit_runtime();
+  return err;
+}
 /**********************************************************/
 
 /****************** Free list based malloc ****************/
@@ -196,7 +220,7 @@ l1_listoc8r_meta *l1_listoc8r_find_feasible_region(size_t size) {
   return temp;
 }
 
-void *l1_listoc8r_malloc(size_t req_size) {
+static void *listoc8r_malloc(size_t req_size) {
   if(req_size == 0)
     return NULL;
 
@@ -252,7 +276,14 @@ void *l1_listoc8r_malloc(size_t req_size) {
   return (void *)((char *)meta_ptr + meta_size);
 }
 
-l1_error l1_listoc8r_free(void *ptr) {
+void *l1_listoc8r_malloc(size_t req_size) {
+  l1_critical_enter();
+  void *ptr = listoc8r_malloc(req_size);
+  l1_critical_exit_runtime();
+  return ptr;
+}
+
+static l1_error listoc8r_free(void *ptr) {
   if(ptr == NULL)
     return SUCCESS;
 
@@ -282,3 +313,157 @@ l1_error l1_listoc8r_free(void *ptr) {
 
   return SUCCESS;
 }
+
+l1_error l1_listoc8r_free(void *ptr) {
+  l1_critical_enter();
+  l1_error err = listoc8r_free(ptr);
+  l1_critical_exit_runtime();
+  return err;
+}
+/**********************************************************/
+
+/************************ Slab malloc *********************/
+void *l1_slab_heap = NULL;
+l1_slab_slot *l1_slab_free_heads[SLAB_NUM_CLASSES];
+
+/* Object size of a class */
+static size_t l1_slab_class_size(unsigned cls) {
+  return SLAB_MIN_OBJECT << cls;
+}
+
+void l1_slab_init(void) {
+  l1_slab_heap = malloc(ALLOC8R_HEAP_SIZE);
+
+  if (l1_slab_heap == NULL) {
+    printf("Unable to allocate %d bytes for the slab allocator\n", ALLOC8R_HEAP_SIZE);
+    exit(1);
+  }
+
+  /* Thread the slots of every segment into its class free list */
+  for (unsigned cls = 0; cls < SLAB_NUM_CLASSES; ++cls) {
+    char *segment = (char *)l1_slab_heap + cls * SLAB_SEGMENT_SIZE;
+    size_t obj_size = l1_slab_class_size(cls);
+    size_t slot_num = SLAB_SEGMENT_SIZE / obj_size;
+
+    for (size_t i = 0; i < slot_num; ++i) {
+      l1_slab_slot *slot = (l1_slab_slot *)(segment + i * obj_size);
+      slot->next = (i + 1 < slot_num) ? (l1_slab_slot *)(segment + (i + 1) * obj_size) : NULL;
+    }
+
+    l1_slab_free_heads[cls] = (l1_slab_slot *)segment;
+  }
+}
+
+void l1_slab_deinit(void) {
+  free(l1_slab_heap);
+  l1_slab_heap = NULL;
+}
+
+static void *slab_malloc(size_t size) {
+  if (size == 0)
+    return NULL;
+
+  if (size > SLAB_MAX_OBJECT) {
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_slab_malloc(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return NULL;
+  }
+
+  /* Smallest class fitting size */
+  unsigned cls = 0;
+  while (l1_slab_class_size(cls) < size) ++cls;
+
+  l1_slab_slot *slot = l1_slab_free_heads[cls];
+
+  if (!slot) {
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_slab_malloc(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return NULL;
+  }
+
+  l1_slab_free_heads[cls] = slot->next;
+
+  return (void *)slot;
+}
+
+void *l1_slab_malloc(size_t size) {
+  l1_critical_enter();
+  void *ptr = slab_malloc(size);
+  l1_critical_exit_runtime();
+  return ptr;
+}
+
+static l1_error slab_free(void *ptr) {
+  if (ptr == NULL)
+    return SUCCESS;
+
+  /* Verify ptr is in the heap, then find its class from the segment */
+  if ((char *)ptr < (char *)l1_slab_heap || 
+      (char *)ptr >= (char *)l1_slab_heap + ALLOC8R_HEAP_SIZE) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_slab_free(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return ERRINVAL;
+  }
+
+  size_t offset = (size_t)ptr - (size_t)l1_slab_heap;
+  unsigned cls = offset / SLAB_SEGMENT_SIZE;
+
+  if ((offset % SLAB_SEGMENT_SIZE) % l1_slab_class_size(cls) != 0) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_slab_free(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return ERRINVAL;
+  }
+
+  l1_slab_slot *slot = (l1_slab_slot *)ptr;
+  slot->next = l1_slab_free_heads[cls];
+  l1_slab_free_heads[cls] = slot;
+
+  return SUCCESS;
+}
+
+l1_error l1_slab_free(void *ptr) {
+  l1_critical_enter();
+  l1_error err = slab_free(ptr);
+  l1_critical_exit_runtime();
+  return err;
+}
+/**********************************************************/
+
+/****************** Size-tiered malloc ********************/
+void l1_tiered_init(void) {
+  l1_slab_init();
+  l1_chunk_init();
+}
+
+void l1_tiered_deinit(void) {
+  l1_chunk_deinit();
+  l1_slab_deinit();
+}
+
+void *l1_tiered_malloc(size_t size) {
+  if (size == 0)
+    return NULL;
+
+  if (size <= SLAB_MAX_OBJECT)
+    return l1_slab_malloc(size);
+
+  return l1_chunk_malloc(size);
+}
+
+l1_error l1_tiered_free(void *ptr) {
+  if (ptr == NULL)
+    return SUCCESS;
+
+  /* The owning tier is the one whose heap contains ptr */
+  if ((char *)ptr >= (char *)l1_slab_heap && 
+      (char *)ptr < (char *)l1_slab_heap + ALLOC8R_HEAP_SIZE)
+    return l1_slab_free(ptr);
+
+  if ((char *)ptr >= (char *)l1_chunk_arena && 
+      (char *)ptr < (char *)(l1_chunk_arena + CHUNK_ARENA_LENGTH))
+    return l1_chunk_free(ptr);
+
+  l1_errno = ERRINVAL;
+  fprintf(stderr, "l1_tiered_free(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+  return ERRINVAL;
+}
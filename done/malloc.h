@@ -179,3 +179,109 @@ extern l1_listoc8r_meta *l1_listoc8r_free_head;
 extern void *l1_listoc8r_heap;
 extern max_align_t l1_listoc8r_magic;
 
+
+/****** Slab allocator: l1_slab ******/
+/* The slab allocator serves small objects from `SLAB_NUM_CLASSES` size
+ * classes, `SLAB_MIN_OBJECT` bytes and doubling up to `SLAB_MAX_OBJECT`. Its
+ * heap is split into one equal-sized segment per class, and each segment is
+ * carved into slots of the class size. Free slots of a class are linked
+ * through their first word, starting at `l1_slab_free_heads[class]`.
+ *
+ * No per-object metadata is stored: the class of an object is given by the
+ * segment it lies in, so freeing only needs the pointer's address.
+ */
+#define SLAB_NUM_CLASSES 8
+#define SLAB_MIN_OBJECT sizeof(max_align_t)
+#define SLAB_MAX_OBJECT (SLAB_MIN_OBJECT << (SLAB_NUM_CLASSES - 1))
+#define SLAB_SEGMENT_SIZE (ALLOC8R_HEAP_SIZE / SLAB_NUM_CLASSES)
+
+/**
+ * A free slot, linked to the next free slot of the same class.
+ */
+typedef struct l1_slab_slot {
+  struct l1_slab_slot *next;
+} l1_slab_slot;
+
+extern void *l1_slab_heap;
+extern l1_slab_slot *l1_slab_free_heads[SLAB_NUM_CLASSES];
+
+/**
+ * @brief      Initializes the slab heap and the free list of every class
+ *
+ * If this function fails to allocate the heap, it must exit with a status
+ * code of 1.
+ */
+void l1_slab_init(void);
+
+/**
+ * @brief      Releases the slab heap
+ */
+void l1_slab_deinit(void);
+
+/**
+ * @brief      Allocates a slot from the smallest class fitting size
+ *
+ * If the requested size is 0, the function must return a NULL pointer. If the
+ * size is larger than `SLAB_MAX_OBJECT` or the class is exhausted, it must set
+ * `l1_errno` to ERRNOMEM and return a NULL pointer.
+ *
+ * @param[in]  size  The size, in bytes, of the object to be allocated.
+ *
+ * @return     A pointer to the slot, or NULL if it fails.
+ */
+void *l1_slab_malloc(size_t size);
+
+/**
+ * @brief      Returns a slot to the free list of its class
+ *
+ * If the provided pointer is NULL, the function must return SUCCESS. If it
+ * is outside the slab heap or not on a slot boundary, the function must set
+ * `l1_errno` and return ERRINVAL.
+ *
+ * @param      ptr   The pointer to the slot to be freed.
+ *
+ * @return     SUCCESS if no errors occured. Otherwise, ERRINVAL.
+ */
+l1_error l1_slab_free(void *ptr);
+
+/****** Size-tiered allocator: l1_tiered ******/
+/* The tiered allocator is a composite of the slab and chunk allocators.
+ * Requests of up to `SLAB_MAX_OBJECT` bytes are served by the slab tier, and
+ * larger (page-sized) requests by the chunk tier. Each tier owns its own
+ * heap, so `l1_tiered_free` finds the owning tier by comparing the pointer
+ * against the heap address ranges, without reading any region header.
+ */
+
+/**
+ * @brief      Initializes both tiers
+ */
+void l1_tiered_init(void);
+
+/**
+ * @brief      Releases the heaps of both tiers
+ */
+void l1_tiered_deinit(void);
+
+/**
+ * @brief      Allocates from the tier matching the requested size
+ *
+ * If the requested size is 0, the function must return a NULL pointer.
+ * On failure, the owning tier sets `l1_errno` to ERRNOMEM.
+ *
+ * @param[in]  size  The size, in bytes, of the region to be allocated.
+ *
+ * @return     A pointer to the allocated region, or NULL if it fails.
+ */
+void *l1_tiered_malloc(size_t size);
+
+/**
+ * @brief      Releases a region to the tier whose heap contains it
+ *
+ * If the provided pointer is NULL, the function must return SUCCESS. If the
+ * pointer lies in neither heap, it sets `l1_errno` and returns ERRINVAL.
+ *
+ * @param      ptr   The pointer to the region to be freed.
+ *
+ * @return     SUCCESS if no errors occured. Otherwise, ERRINVAL.
+ */
+l1_error l1_tiered_free(void *ptr);
@@ -0,0 +1,165 @@
+/**
+ * @file preempt.c
+ * @brief Implementation of preemption by a timer signal
+ */
+#define _GNU_SOURCE
+#include <link.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "preempt.h"
+#include "priority.h"
+#include "schedule.h"
+/* After thread_info.h, whose errno field the errno macro would rename */
+#include <errno.h>
+
+/* Not named by older glibc headers */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+L1_THREAD_LOCAL volatile sig_atomic_t l1_preempt_depth = 0;
+L1_THREAD_LOCAL volatile sig_atomic_t l1_preempt_pending = 0;
+
+/* The timer of the OS thread preemption was started on */
+static struct {
+  bool started;                 /** The timer is armed */
+  timer_t timer;                /** POSIX timer sending the signal */
+  int signo;                    /** SIGALRM or SIGVTALRM */
+  uintptr_t app_start;          /** Code of the application, where threads */
+  uintptr_t app_end;            /** may be preempted */
+  struct sigaction old_action;  /** Handler of signo before start */
+} preempt;
+
+/* Finds the executable segments of the main program, the first object */
+static int find_app_code(struct dl_phdr_info* info, size_t size, void* data) {
+  (void)size;
+  (void)data;
+  preempt.app_start = UINTPTR_MAX;
+  preempt.app_end = 0;
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+      uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+      if (start < preempt.app_start) preempt.app_start = start;
+      if (start + phdr->p_memsz > preempt.app_end) preempt.app_end = start + phdr->p_memsz;
+    }
+  }
+  return 1;
+}
+
+static void preempt_handler(int signo, siginfo_t* info, void* context) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  uintptr_t pc = ((ucontext_t*)context)->uc_mcontext.gregs[REG_RIP];
+  int saved_errno = errno;
+  (void)signo;
+  (void)info;
+
+  if (!sched_info) {
+    return;
+  }
+  l1_thread_info* current = sched_info->current;
+
+  /* tsys is never preempted, and current is NULL while the scheduler picks
+   * the next thread */
+  if (!current || current == sched_info->tsys ||
+      ++current->preempt_ticks * MIN_SLICE < l1_priority_slice_size(current->priority_level)) {
+    errno = saved_errno;
+    return;
+  }
+  if (l1_preempt_depth > 0) {
+    /* Yields when it leaves the critical section */
+    l1_preempt_pending = 1;
+  } else if (pc >= preempt.app_start && pc < preempt.app_end) {
+    /* Back here when the thread is scheduled again */
+    yield_preempted();
+  }
+  /* Otherwise in libc or the runtime, which may hold locks or be switching:
+   * the next tick tries again */
+  errno = saved_errno;
+}
+
+l1_error l1_preempt_start(l1_preempt_clock clock, uint64_t tick_ns) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  /* __morestack is linked into the application, and must not be preempted */
+#ifdef L1_SPLIT_STACK
+  bool split_stack = true;
+#else
+  bool split_stack = false;
+#endif
+  if (!sched_info || sched_info->worker || preempt.started || split_stack) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_preempt_start(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  if (tick_ns == 0) {
+    tick_ns = MIN_SLICE;
+  }
+  preempt.signo = clock == L1_PREEMPT_VIRTUAL ? SIGVTALRM : SIGALRM;
+  dl_iterate_phdr(find_app_code, NULL);
+
+  /* The handler switches threads and comes back much later: the signal must
+   * not stay blocked meanwhile. Nested signals interrupt the runtime, so they
+   * do not switch. */
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = preempt_handler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(preempt.signo, &action, &preempt.old_action);
+
+  /* Only the scheduler's OS thread gets the signal */
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = preempt.signo;
+  event.sigev_notify_thread_id = gettid();
+
+  clockid_t clock_id = clock == L1_PREEMPT_VIRTUAL ? CLOCK_THREAD_CPUTIME_ID : CLOCK_MONOTONIC;
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = tick_ns / 1000000000ULL;
+  spec.it_interval.tv_nsec = tick_ns % 1000000000ULL;
+  spec.it_value = spec.it_interval;
+
+  if (timer_create(clock_id, &event, &preempt.timer) != 0) {
+    sigaction(preempt.signo, &preempt.old_action, NULL);
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_preempt_start(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  timer_settime(preempt.timer, 0, &spec, NULL);
+  preempt.started = true;
+  return SUCCESS;
+}
+
+void l1_preempt_stop(void) {
+  if (!preempt.started) {
+    return;
+  }
+  /* The signal is never blocked, so none is left once the timer is deleted */
+  timer_delete(preempt.timer);
+  sigaction(preempt.signo, &preempt.old_action, NULL);
+  preempt.started = false;
+  l1_preempt_pending = 0;
+}
+
+void l1_critical_enter(void) {
+  l1_preempt_depth++;
+}
+
+void l1_critical_exit(void) {
+  if (--l1_preempt_depth == 0 && l1_preempt_pending) {
+    yield_preempted();
+  }
+}
+
+void l1_critical_exit_runtime(void) {
+  l1_preempt_depth--;
+}
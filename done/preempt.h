@@ -0,0 +1,80 @@
+/**
+ * @file preempt.h
+ * @brief Opt-in preemption of green threads by a timer signal
+ *
+ * Once started, a POSIX timer sends a signal to the scheduler's OS thread
+ * every tick. The handler counts the ticks of the running thread, and when
+ * its slice at its priority level (`l1_priority_slice_size`) is used up, it
+ * yields on behalf of the thread from the signal frame. The kernel saved all
+ * the registers of the thread in that frame, so they are all back when the
+ * thread is scheduled again and the handler returns.
+ *
+ * A thread is only preempted at a safe point: in the code of the application
+ * itself, not in libc or in the runtime library, which may hold locks or be
+ * switching, and outside of critical sections. Otherwise the next tick tries
+ * again. The runtime marks its switches and the allocators of malloc.h as
+ * critical sections, and the application marks code which must not be
+ * interleaved with other threads with `l1_critical_enter` and
+ * `l1_critical_exit`. A thread whose slice runs out in a critical section
+ * of the application yields when it leaves the outermost one. The runtime
+ * may be about to switch the thread when it leaves its own sections, so it
+ * never yields there: the thread is preempted at the next tick in the
+ * application, or when it leaves a section of its own.
+ *
+ * Preemption is not available in M:N mode, nor with SPLIT_STACK=1, since
+ * __morestack runs in the application.
+ */
+#pragma once
+#include <signal.h>
+#include <stdint.h>
+#include "error.h"
+
+typedef enum {
+  L1_PREEMPT_REAL,              /* Wall-clock ticks, with SIGALRM */
+  L1_PREEMPT_VIRTUAL,           /* CPU time ticks of the OS thread, with SIGVTALRM */
+} l1_preempt_clock;
+
+/* Depth of nested critical sections of the running thread, saved by `yield`
+ * for the others */
+extern L1_THREAD_LOCAL volatile sig_atomic_t l1_preempt_depth;
+/* The slice of the running thread ran out in a critical section */
+extern L1_THREAD_LOCAL volatile sig_atomic_t l1_preempt_pending;
+
+/**
+ * @brief Starts preempting the threads of the scheduler of the calling OS
+ * thread
+ *
+ * @param  clock    Clock the ticks are measured with
+ * @param  tick_ns  Length of a tick in ns, 0 for MIN_SLICE. A tick
+ *                  stands for MIN_SLICE, so a thread runs for
+ *                  l1_priority_slice_size(level) / MIN_SLICE ticks.
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ *          ERRINVAL without a scheduler, in M:N or split-stack mode, or if
+ *          already started
+ */
+l1_error l1_preempt_start(l1_preempt_clock clock, uint64_t tick_ns);
+
+/**
+ * @brief Stops the timer, threads only switch when they yield again
+ */
+void l1_preempt_stop(void);
+
+/**
+ * @brief Enters a critical section, where the thread is not preempted
+ *
+ * Critical sections nest, and a thread may yield in one.
+ */
+void l1_critical_enter(void);
+
+/**
+ * @brief Leaves a critical section, and yields if the slice of the thread
+ * ran out in it
+ */
+void l1_critical_exit(void);
+
+/**
+ * @brief Leaves a critical section of the runtime, without yielding
+ *
+ * A preemption pending at the outermost exit is left to the next tick.
+ */
+void l1_critical_exit_runtime(void);
@@ -13,15 +13,10 @@ typedef int l1_priority;
 #define TOP_PRIORITY 10
 #define LOWEST_PRIORITY 0
 
-#ifdef USE_UNIX_TIME
-#define MIN_SLICE 2
-/* Maximum total time you can run at certain priority */
-#define TIME_PRIORITY_THRESHOLD ((uint64_t)200)
-#else
-#define MIN_SLICE 1000
-/* Maximum total time you can run at certain priority */
-#define TIME_PRIORITY_THRESHOLD ((uint64_t)1000000)
-#endif
+/* Time slice at TOP_PRIORITY, in ns. Each level below adds one MIN_SLICE. */
+#define MIN_SLICE (100 * L1_TIME_US)
+/* Maximum total time you can run at certain priority, in ns */
+#define TIME_PRIORITY_THRESHOLD (10 * L1_TIME_MS)
 
 /**
  * @brief Returns the value of a time slice at priority level val
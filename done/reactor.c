@@ -0,0 +1,128 @@
+/**
+ * @file reactor.c
+ * @brief Implementation of the epoll reactor
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "reactor.h"
+/* After thread_info.h, whose errno field the errno macro would rename */
+#include <errno.h>
+
+#define REACTOR_INITIAL_CAPACITY 64
+
+void reactor_init(l1_reactor* reactor) {
+  memset(reactor, 0, sizeof(l1_reactor));
+  reactor->epfd = -1;
+}
+
+void reactor_free(l1_reactor* reactor) {
+  if (reactor->epfd >= 0) {
+    close(reactor->epfd);
+  }
+  free(reactor->waiters);
+  free(reactor->registered);
+  reactor_init(reactor);
+}
+
+/* Makes the tables large enough for fd */
+static l1_error reactor_reserve(l1_reactor* reactor, int fd) {
+  size_t capacity = reactor->capacity ? reactor->capacity : REACTOR_INITIAL_CAPACITY;
+
+  if ((size_t)fd < reactor->capacity) {
+    return SUCCESS;
+  }
+  while (capacity <= (size_t)fd) {
+    capacity *= 2;
+  }
+  l1_thread_info** waiters = realloc(reactor->waiters, capacity * sizeof(l1_thread_info*));
+  if (!waiters) {
+    return ERRNOMEM;
+  }
+  reactor->waiters = waiters;
+  bool* registered = realloc(reactor->registered, capacity * sizeof(bool));
+  if (!registered) {
+    return ERRNOMEM;
+  }
+  reactor->registered = registered;
+  memset(waiters + reactor->capacity, 0, (capacity - reactor->capacity) * sizeof(l1_thread_info*));
+  memset(registered + reactor->capacity, 0, (capacity - reactor->capacity) * sizeof(bool));
+  reactor->capacity = capacity;
+  return SUCCESS;
+}
+
+l1_error reactor_add(l1_reactor* reactor, l1_thread_info* thread, int fd,
+                     uint32_t events) {
+  struct epoll_event ev = { .events = events | EPOLLONESHOT, .data.fd = fd };
+
+  if (fd < 0) {
+    return ERRINVAL;
+  }
+  if (reactor->epfd < 0) {
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epfd < 0) {
+      return ERRNOMEM;
+    }
+  }
+  if (reactor_reserve(reactor, fd) != SUCCESS) {
+    return ERRNOMEM;
+  }
+  if (reactor->waiters[fd]) {
+    return ERRINVAL;
+  }
+
+  /* Rearm the fd if it is still registered. The table can be wrong both
+   * ways once fds are closed and reused, or duplicated */
+  int op = reactor->registered[fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(reactor->epfd, op, fd, &ev) < 0) {
+    if (errno != ENOENT && errno != EEXIST) {
+      return ERRINVAL;
+    }
+    op = (errno == ENOENT) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(reactor->epfd, op, fd, &ev) < 0) {
+      return ERRINVAL;
+    }
+  }
+  reactor->registered[fd] = true;
+  thread->io_fd = fd;
+  thread->io_events = events;
+  reactor->waiters[fd] = thread;
+  reactor->waiting++;
+  return SUCCESS;
+}
+
+static void reactor_remove(l1_reactor* reactor, l1_thread_info* thread) {
+  reactor->waiters[thread->io_fd] = NULL;
+  reactor->waiting--;
+}
+
+/* The fd stays armed, its event is ignored once it comes */
+void reactor_cancel(l1_reactor* reactor, l1_thread_info* thread) {
+  reactor_remove(reactor, thread);
+  thread->io_events = 0;
+}
+
+size_t reactor_poll(l1_reactor* reactor, int timeout, void (*wake)(l1_thread_info*)) {
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+  size_t woken = 0;
+
+  if (reactor->waiting == 0) {
+    return 0;
+  }
+
+  /* Interrupted by a signal: same as no event */
+  int n = epoll_wait(reactor->epfd, events, REACTOR_MAX_EVENTS, timeout);
+  for (int i = 0; i < n; ++i) {
+    int fd = events[i].data.fd;
+    l1_thread_info* thread = (size_t)fd < reactor->capacity ? reactor->waiters[fd] : NULL;
+
+    if (thread) {
+      thread->io_events = events[i].events;
+      reactor_remove(reactor, thread);
+      wake(thread);
+      woken++;
+    }
+  }
+  return woken;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file reactor.h
+ * @brief epoll-based readiness notification for threads in IO_WAIT
+ *
+ * At most one thread waits on an fd at a time. The fd is registered with
+ * EPOLLONESHOT and stays registered after the event, so waiting on it again
+ * only rearms it. Timeouts are up to the caller, see `reactor_cancel`.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "error.h"
+#include "thread_info.h"
+
+#define REACTOR_MAX_EVENTS 256
+
+typedef struct {
+  int epfd;                     /** epoll instance, -1 until the first wait */
+  l1_thread_info** waiters;     /** Thread waiting on each fd, by fd */
+  bool* registered;             /** The fd may still be in the epoll set */
+  size_t capacity;              /** Number of fds the tables have room for */
+  size_t waiting;               /** Number of threads waiting */
+} l1_reactor;
+
+/**
+ * @brief Initializes a reactor, without any system resource yet
+ */
+void reactor_init(l1_reactor* reactor);
+
+/**
+ * @brief Frees the epoll instance and the tables
+ */
+void reactor_free(l1_reactor* reactor);
+
+/**
+ * @brief Registers thread as waiting for events (EPOLLIN, EPOLLOUT, ...) on
+ * fd
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if fd cannot be polled or another thread already waits on it.
+ */
+l1_error reactor_add(l1_reactor* reactor, l1_thread_info* thread, int fd,
+                     uint32_t events);
+
+/**
+ * @brief The thread stops waiting, its io_events is set to 0
+ */
+void reactor_cancel(l1_reactor* reactor, l1_thread_info* thread);
+
+/**
+ * @brief Calls wake for every waiting thread whose fd is ready, after
+ * setting its io_events to the ready events
+ *
+ * Waits up to timeout ms (forever if negative) for one fd to be ready.
+ *
+ * @return The number of threads woken up
+ */
+size_t reactor_poll(l1_reactor* reactor, int timeout, void (*wake)(l1_thread_info*));
@@ -0,0 +1,130 @@
+/**
+ * @file run_queue.c
+ * @brief Implementation of the per-priority run queues
+ */
+#include "run_queue.h"
+
+#define LEVELS_MASK ((1U << NUM_PRIORITIES) - 1)
+
+/* Ring slot of the waiting threads at level p */
+static unsigned waiting_slot(l1_run_queue* rq, l1_priority p) {
+  return (unsigned)((p - LOWEST_PRIORITY + NUM_PRIORITIES
+                     - rq->boosts % NUM_PRIORITIES) % NUM_PRIORITIES);
+}
+
+static void level_append(l1_run_level* level, l1_thread_info* thread) {
+  thread->rq_next = NULL;
+  thread->rq_prev = level->tail;
+  if (level->tail) {
+    level->tail->rq_next = thread;
+  } else {
+    level->head = thread;
+  }
+  level->tail = thread;
+}
+
+static void level_unlink(l1_run_level* level, l1_thread_info* thread) {
+  if (thread->rq_prev) {
+    thread->rq_prev->rq_next = thread->rq_next;
+  } else {
+    level->head = thread->rq_next;
+  }
+  if (thread->rq_next) {
+    thread->rq_next->rq_prev = thread->rq_prev;
+  } else {
+    level->tail = thread->rq_prev;
+  }
+  thread->rq_prev = thread->rq_next = NULL;
+}
+
+l1_priority run_queue_level(l1_run_queue* rq, l1_thread_info* thread) {
+  if (thread->got_scheduled) {
+    return thread->priority_level;
+  }
+  uint64_t boosted = rq->boosts - thread->rq_boosts;
+
+  if (boosted >= (uint64_t)(TOP_PRIORITY - thread->priority_level)) {
+    return TOP_PRIORITY;
+  }
+  return thread->priority_level + (l1_priority)boosted;
+}
+
+void run_queue_add(l1_run_queue* rq, l1_thread_info* thread) {
+  if (thread->rq_queued) {
+    return;
+  }
+  if (thread->got_scheduled) {
+    unsigned p = thread->priority_level - LOWEST_PRIORITY;
+
+    level_append(&rq->ran[p], thread);
+    rq->ran_bitmap |= 1U << p;
+  } else {
+    unsigned s = waiting_slot(rq, thread->priority_level);
+
+    thread->rq_boosts = rq->boosts;
+    level_append(&rq->waiting[s], thread);
+    rq->waiting_bitmap |= 1U << s;
+  }
+  thread->rq_queued = true;
+  rq->size++;
+}
+
+void run_queue_remove(l1_run_queue* rq, l1_thread_info* thread) {
+  if (!thread->rq_queued) {
+    return;
+  }
+  if (thread->got_scheduled) {
+    unsigned p = thread->priority_level - LOWEST_PRIORITY;
+
+    level_unlink(&rq->ran[p], thread);
+    if (!rq->ran[p].head) rq->ran_bitmap &= ~(1U << p);
+  } else {
+    /* Apply the boosts it got while waiting */
+    thread->priority_level = run_queue_level(rq, thread);
+    unsigned s = waiting_slot(rq, thread->priority_level);
+
+    level_unlink(&rq->waiting[s], thread);
+    if (!rq->waiting[s].head) rq->waiting_bitmap &= ~(1U << s);
+  }
+  thread->rq_queued = false;
+  rq->size--;
+}
+
+l1_thread_info* run_queue_highest(l1_run_queue* rq) {
+  if (!rq->size) {
+    return NULL;
+  }
+  /* Rotate the waiting bitmap from ring slots to levels */
+  unsigned shift = waiting_slot(rq, LOWEST_PRIORITY);
+  uint32_t waiting_levels = ((rq->waiting_bitmap >> shift) |
+                             (rq->waiting_bitmap << (NUM_PRIORITIES - shift))) & LEVELS_MASK;
+  uint32_t levels = rq->ran_bitmap | waiting_levels;
+  l1_priority p = LOWEST_PRIORITY + 31 - __builtin_clz(levels);
+
+  if (waiting_levels & (1U << (p - LOWEST_PRIORITY))) {
+    return rq->waiting[waiting_slot(rq, p)].head;
+  }
+  return rq->ran[p - LOWEST_PRIORITY].head;
+}
+
+void run_queue_boost(l1_run_queue* rq) {
+  unsigned top = waiting_slot(rq, TOP_PRIORITY);
+  unsigned below = waiting_slot(rq, TOP_PRIORITY - 1);
+  l1_run_level* at_top = &rq->waiting[top];
+  l1_run_level* reaching_top = &rq->waiting[below];
+
+  /* The threads already at the top go before the ones reaching it */
+  if (at_top->head) {
+    if (reaching_top->head) {
+      at_top->tail->rq_next = reaching_top->head;
+      reaching_top->head->rq_prev = at_top->tail;
+    } else {
+      reaching_top->tail = at_top->tail;
+    }
+    reaching_top->head = at_top->head;
+    at_top->head = at_top->tail = NULL;
+    rq->waiting_bitmap = (rq->waiting_bitmap & ~(1U << top)) | (1U << below);
+  }
+  /* The top slot becomes the lowest level's, the one below becomes the top */
+  rq->boosts++;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file run_queue.h
+ * @brief Per-priority run queues for the MLFQ policy
+ *
+ * The runnable threads which are not running are kept in one FIFO queue per
+ * priority level, plus a bitmap of the non-empty levels, so that the thread
+ * to run next is found in O(1) whatever the number of threads.
+ *
+ * Threads which did not get scheduled since they were created or demoted
+ * are boosted one level every boost period. Instead of moving them, they
+ * are kept in a ring of queues indexed by level minus the number of boosts:
+ * a boost only rotates the ring and merges the two queues which reach the
+ * top level. The priority_level of such a thread is only updated when it
+ * leaves the run queue.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "thread_info.h"
+#include "priority.h"
+
+#define NUM_PRIORITIES (TOP_PRIORITY - LOWEST_PRIORITY + 1)
+
+/**
+ * @brief A FIFO queue of threads, linked through rq_prev and rq_next
+ */
+typedef struct {
+  l1_thread_info* head;
+  l1_thread_info* tail;
+} l1_run_level;
+
+typedef struct {
+  l1_run_level ran[NUM_PRIORITIES];      /** Threads which got scheduled, per level */
+  l1_run_level waiting[NUM_PRIORITIES];  /** Threads which did not, per ring slot */
+  uint32_t ran_bitmap;                   /** Bit p is set if ran[p] is not empty */
+  uint32_t waiting_bitmap;               /** Bit s is set if waiting[s] is not empty */
+  uint64_t boosts;                       /** Number of boosts so far */
+  size_t size;                           /** Number of queued threads */
+} l1_run_queue;
+
+/**
+ * @brief Queues a thread at the tail of its priority level
+ *
+ * @warning The got_scheduled and priority_level fields of the thread must
+ * not change while it is queued, see `run_queue_remove`.
+ */
+void run_queue_add(l1_run_queue* rq, l1_thread_info* thread);
+
+/**
+ * @brief Removes a thread from the run queue, if it is queued
+ *
+ * The priority_level of the thread is updated with the boosts it got while
+ * it was queued.
+ */
+void run_queue_remove(l1_run_queue* rq, l1_thread_info* thread);
+
+/**
+ * @brief Returns the oldest thread of the highest non-empty level, or NULL
+ *
+ * At the same level, threads which did not get scheduled go first.
+ */
+l1_thread_info* run_queue_highest(l1_run_queue* rq);
+
+/**
+ * @brief Boosts all queued threads which did not get scheduled by one level
+ */
+void run_queue_boost(l1_run_queue* rq);
+
+/**
+ * @brief Returns the priority level a queued thread is at
+ */
+l1_priority run_queue_level(l1_run_queue* rq, l1_thread_info* thread);
@@ -0,0 +1,300 @@
+/**
+ * @file sched_mn.c
+ * @brief Implementation of the M:N scheduler
+ */
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "malloc.h"
+#include "preempt.h"
+#include "sched_mn.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "stack_stats.h"
+#include "tid_table.h"
+#include "wait_queue.h"
+
+static struct {
+  l1_worker* workers;           /** The workers */
+  unsigned num_workers;         /** Number of workers */
+  pthread_mutex_t lock;         /** Protects tids, joins and exits */
+  l1_tid_table tids;            /** Threads which are not collected, by ID */
+  atomic_long ready;            /** Threads which are runnable or running */
+} mn;
+
+l1_worker* l1_mn_worker(unsigned id) {
+  return id < mn.num_workers ? &mn.workers[id] : NULL;
+}
+
+static l1_worker* current_worker(void) {
+  return get_scheduler()->worker;
+}
+
+l1_tid l1_mn_uniq_tid(void) {
+  pthread_mutex_lock(&mn.lock);
+  l1_tid tid = tid_table_alloc(&mn.tids);
+  pthread_mutex_unlock(&mn.lock);
+  return tid;
+}
+
+void l1_mn_release_tid(l1_tid tid) {
+  pthread_mutex_lock(&mn.lock);
+  tid_table_release(&mn.tids, tid);
+  pthread_mutex_unlock(&mn.lock);
+}
+
+/* Makes thread runnable in the deque of worker w, which must be current */
+static void worker_push(l1_worker* w, l1_thread_info* thread) {
+  thread->state = RUNNABLE;
+  atomic_fetch_add(&mn.ready, 1);
+  if (deque_push(&w->deque, thread) != SUCCESS) {
+    fprintf(stderr, "Error: unable to grow a worker deque.\n");
+    exit(-1);
+  }
+}
+
+void l1_mn_add(l1_thread_info* thread) {
+  pthread_mutex_lock(&mn.lock);
+  l1_error err = tid_table_insert(&mn.tids, thread);
+  pthread_mutex_unlock(&mn.lock);
+
+  if (err != SUCCESS) {
+    fprintf(stderr, "Error: unable to index a thread by ID!\n");
+    exit(-1);
+  }
+  thread->prev = thread->next = NULL;
+  worker_push(current_worker(), thread);
+}
+
+l1_error l1_mn_join(l1_tid target, void** retval) {
+  l1_thread_info* cur_t_info = get_scheduler()->current;
+  void* recv = NULL;
+
+  /* The worker checks the target once we are switched out */
+  cur_t_info->joined_target = target;
+  cur_t_info->join_recv = &recv;
+  cur_t_info->errno = SUCCESS;
+  cur_t_info->state = BLOCKED;
+  yield(-1);
+
+  cur_t_info->joined_target = -1;
+  cur_t_info->join_recv = NULL;
+  if (cur_t_info->errno) {
+    l1_errno = cur_t_info->errno;
+    fprintf(stderr, "l1_thread_join(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  if (retval) *retval = recv;
+  return SUCCESS;
+}
+
+/* Removes a finished thread whose joiners got its retval, under the lock */
+static void collect(l1_thread_info* zombie) {
+  zombie->state = DEAD;
+  tid_table_remove(&mn.tids, zombie->id);
+  tid_table_release(&mn.tids, zombie->id);
+}
+
+/* thread switched out to join a thread */
+static void worker_join(l1_worker* w, l1_thread_info* thread) {
+  l1_thread_info* dead = NULL;
+
+  pthread_mutex_lock(&mn.lock);
+  l1_thread_info* target = tid_table_find(&mn.tids, thread->joined_target);
+
+  if (!target || target == thread) {
+    thread->errno = ERRINVAL;
+  } else if (target->exited) {
+    *thread->join_recv = target->retval;
+    collect(target);
+    dead = target;
+  } else {
+    /* Woken up by the target when it exits */
+    wait_queue_add(&target->joiners, thread);
+    thread = NULL;
+  }
+  pthread_mutex_unlock(&mn.lock);
+
+  if (thread) {
+    thread->state = RUNNABLE;
+    if (deque_push(&w->deque, thread) != SUCCESS) {
+      fprintf(stderr, "Error: unable to grow a worker deque.\n");
+      exit(-1);
+    }
+  } else {
+    atomic_fetch_sub(&mn.ready, 1);
+  }
+  libc_free(dead);
+}
+
+/* thread switched out after returning from its function */
+static void worker_exit(l1_worker* w, l1_thread_info* thread) {
+  l1_thread_info* joiner;
+  bool joined;
+
+  pthread_mutex_lock(&mn.lock);
+  l1_stack_stats_record(thread);
+  /* Once exited is set, a joiner may free the thread */
+  l1_stack* stack = thread->thread_stack;
+  thread->thread_stack = NULL;
+  thread->exited = true;
+  joined = !wait_queue_is_empty(&thread->joiners);
+  while ((joiner = wait_queue_pop(&thread->joiners)) != NULL) {
+    *joiner->join_recv = thread->retval;
+    worker_push(w, joiner);
+  }
+  if (joined) {
+    collect(thread);
+  }
+  pthread_mutex_unlock(&mn.lock);
+
+  /* Only retval is needed from a zombie, so its stack can already be reused */
+  l1_stack_free(stack);
+  atomic_fetch_sub(&mn.ready, 1);
+  if (joined) {
+    libc_free(thread);
+  }
+}
+
+static l1_thread_info* worker_steal(l1_worker* w) {
+  for (unsigned i = 1; i < mn.num_workers; ++i) {
+    /* xorshift64 */
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+
+    l1_worker* victim = &mn.workers[w->rng % mn.num_workers];
+    if (victim == w) continue;
+
+    l1_thread_info* thread = deque_steal(&victim->deque);
+    if (thread) {
+      w->steals++;
+      return thread;
+    }
+  }
+  return NULL;
+}
+
+static l1_thread_info* worker_next(l1_worker* w) {
+  l1_thread_info* next = NULL;
+
+  /* Give the threads which yielded a turn every SCHED_PERIOD threads */
+  if (w->picks++ % SCHED_PERIOD == 0) next = thread_list_pop(&w->yielded);
+  if (!next) next = deque_take(&w->deque);
+  if (!next) next = thread_list_pop(&w->yielded);
+  if (!next) next = worker_steal(w);
+  return next;
+}
+
+/* The main loop of a worker, on its tsys */
+static void worker_loop(l1_worker* w) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  /* New threads leave the critical section of their first switch */
+  sig_atomic_t depth = l1_preempt_depth;
+
+  l1_preempt_depth = 1;
+  while (atomic_load(&mn.ready) > 0) {
+    l1_thread_info* next = worker_next(w);
+
+    if (!next) {
+      sched_yield();
+      continue;
+    }
+    sched_info->current = next;
+    next->state = RUNNING;
+    switch_stack(next->thread_stack, sched_info->tsys->thread_stack);
+    sched_info->current = NULL;
+
+    if (next->state == RUNNING) {
+      next->state = RUNNABLE;
+      thread_list_add(&w->yielded, next);
+    } else if (next->state == BLOCKED) {
+      worker_join(w, next);
+    } else if (next->state == ZOMBIE) {
+      worker_exit(w, next);
+    }
+  }
+  l1_preempt_depth = depth;
+}
+
+static void* worker_main(void* arg) {
+  l1_worker* w = arg;
+
+  initialize_scheduler(l1_round_robin_policy);
+  get_scheduler()->worker = w;
+  worker_loop(w);
+  clean_up_scheduler();
+  return NULL;
+}
+
+l1_error l1_mn_init(unsigned workers) {
+  if (workers == 0) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_mn_init(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  mn.workers = calloc(workers, sizeof(l1_worker));
+  if (!mn.workers) {
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_mn_init(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  mn.num_workers = workers;
+  for (unsigned i = 0; i < workers; ++i) {
+    mn.workers[i].id = i;
+    mn.workers[i].rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+    if (deque_init(&mn.workers[i].deque) != SUCCESS) {
+      mn.num_workers = i;
+      l1_mn_clean_up();
+      l1_errno = ERRNOMEM;
+      fprintf(stderr, "l1_mn_init(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+      return l1_errno;
+    }
+  }
+  pthread_mutex_init(&mn.lock, NULL);
+  atomic_init(&mn.ready, 0);
+
+  initialize_scheduler(l1_round_robin_policy);
+  get_scheduler()->worker = &mn.workers[0];
+  return SUCCESS;
+}
+
+void l1_mn_schedule(void) {
+  unsigned started = 1;
+
+  for (; started < mn.num_workers; ++started) {
+    if (pthread_create(&mn.workers[started].os_thread, NULL, worker_main,
+                       &mn.workers[started]) != 0) {
+      fprintf(stderr, "Error: unable to start worker %u, running with %u.\n",
+              started, started);
+      break;
+    }
+  }
+  worker_loop(&mn.workers[0]);
+  for (unsigned i = 1; i < started; ++i)
+    pthread_join(mn.workers[i].os_thread, NULL);
+  printf("Program terminating!\n");
+}
+
+void l1_mn_clean_up(void) {
+  /* Threads which finished but were never joined */
+  for (size_t i = 0; i < mn.tids.capacity; ++i) {
+    l1_thread_info* thread = mn.tids.entries[i].thread;
+
+    if (thread) {
+      l1_stack_free(thread->thread_stack);
+      libc_free(thread);
+    }
+  }
+  tid_table_free(&mn.tids);
+  for (unsigned i = 0; i < mn.num_workers; ++i)
+    deque_free(&mn.workers[i].deque);
+  free(mn.workers);
+  mn.workers = NULL;
+  mn.num_workers = 0;
+  if (get_scheduler()) {
+    clean_up_scheduler();
+  }
+}
@@ -0,0 +1,88 @@
+/**
+ * @file sched_mn.h
+ * @brief M:N scheduling of green threads on several worker OS threads
+ *
+ * Each worker has its own scheduler and tsys, a Chase-Lev deque of the
+ * threads it created or woke up, and a FIFO of the threads which yielded
+ * on it. A worker runs the newest thread of its deque, gives the yielded
+ * threads a turn every SCHED_PERIOD threads, and steals the oldest thread
+ * of a random other worker when it has nothing to run. The scheduler
+ * policy is not used in this mode, and yield targets are ignored.
+ *
+ * `l1_thread_create` and `l1_thread_join` work across workers: thread IDs,
+ * joins and thread exits are serialized by one lock. The allocator used by
+ * the threads must be thread-safe (libc), and shared stacks are not
+ * available (ERRINVAL).
+ *
+ * @warning Threads move between workers, so code running on a green thread
+ * must not keep the result of `get_scheduler` across a call which may
+ * switch (yield, join, coroutines).
+ */
+#pragma once
+#include <pthread.h>
+#include <stdint.h>
+#include "deque.h"
+#include "error.h"
+#include "thread_info.h"
+#include "thread_list.h"
+
+typedef struct l1_worker {
+  unsigned id;                  /** Index of the worker */
+  pthread_t os_thread;          /** OS thread running the worker */
+  l1_deque deque;               /** Runnable threads, others may steal them */
+  l1_thread_list yielded;       /** Threads which yielded, in FIFO order */
+  uint64_t picks;               /** Threads run so far */
+  uint64_t steals;              /** Threads stolen from other workers */
+  uint64_t rng;                 /** State of the victim picker */
+} l1_worker;
+
+/**
+ * @brief Sets up M:N mode with the given number of workers
+ *
+ * The calling OS thread becomes worker 0, and gets a scheduler as with
+ * `initialize_scheduler`. Threads created before `l1_mn_schedule` start
+ * in the deque of worker 0.
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_mn_init(unsigned workers);
+
+/**
+ * @brief Runs the workers until no thread is runnable anymore
+ *
+ * Worker 0 runs on the calling OS thread.
+ */
+void l1_mn_schedule(void);
+
+/**
+ * @brief Frees the workers, the threads nobody joined, and the scheduler of
+ * the calling OS thread
+ */
+void l1_mn_clean_up(void);
+
+/**
+ * @brief Returns the worker with the given index, NULL if there is none
+ */
+l1_worker* l1_mn_worker(unsigned id);
+
+/* Used by the scheduler and threads in M:N mode */
+
+/**
+ * @brief Generate unique TIDs, shared by all workers
+ */
+l1_tid l1_mn_uniq_tid(void);
+
+/**
+ * @brief Makes the ID of a thread which was never added reusable
+ */
+void l1_mn_release_tid(l1_tid tid);
+
+/**
+ * @brief Makes a new thread runnable on the current worker
+ */
+void l1_mn_add(l1_thread_info* thread);
+
+/**
+ * @brief `l1_thread_join` in M:N mode
+ */
+l1_error l1_mn_join(l1_tid target, void** retval);
@@ -24,16 +24,27 @@ l1_thread_info* l1_smallest_cycles_policy(l1_thread_info* prev, l1_thread_info*
 
   l1_scheduler_info *scheduler = get_scheduler();
 
-  return thread_list_min_total_time(&scheduler->thread_arrays[RUNNABLE]);
+  return thread_heap_min(&scheduler->run_heap);
+}
+
+/* Moves a thread one priority level down, in the run queue too */
+static void mlfq_demote(l1_run_queue* rq, l1_thread_info* thread) {
+  bool queued = thread->rq_queued;
+
+  if (queued) run_queue_remove(rq, thread);
+  l1_priority_decrease(&thread->priority_level);
+  thread->got_scheduled = 0;
+  l1_time_init(&thread->total_time);
+  if (queued) run_queue_add(rq, thread);
 }
 
 /** Schedules threads according to mlfq policy */
 l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next) {
   l1_scheduler_info *scheduler = get_scheduler();
 
-  /* Boost any thread applicable in RUNNABLE list*/
+  /* Boost any thread applicable in the run queue */
   if (!scheduler->sched_ticks) {
-    thread_list_boost_priority(&scheduler->thread_arrays[RUNNABLE]);
+    run_queue_boost(&scheduler->run_queue);
   }
 
   /* Demote prev: time slice used up or threshold time exceeded(unless lowest priority)*/
@@ -42,16 +53,179 @@ l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next) {
 
   if (l1_time_is_smaller(prev_slice_time, l1_priority_slice_size(prev->priority_level)) == 0 && 
       prev->priority_level != LOWEST_PRIORITY) {
-    l1_priority_decrease(&prev->priority_level);
-    prev->got_scheduled = 0;
-    l1_time_init(&prev->total_time);
+    mlfq_demote(&scheduler->run_queue, prev);
   } else if (l1_time_is_smaller(TIME_PRIORITY_THRESHOLD, prev->total_time) == 1 && 
              prev->priority_level != LOWEST_PRIORITY) {
-    l1_priority_decrease(&prev->priority_level);
-    prev->got_scheduled = 0;
-    l1_time_init(&prev->total_time);
+    mlfq_demote(&scheduler->run_queue, prev);
+  }
+
+  return run_queue_highest(&scheduler->run_queue);
+}
+
+static void mlfq_enqueue(l1_thread_info* thread) {
+  run_queue_add(&get_scheduler()->run_queue, thread);
+}
+
+static void mlfq_dequeue(l1_thread_info* thread) {
+  run_queue_remove(&get_scheduler()->run_queue, thread);
+}
+
+/* The heap key of a thread is its total time at the end of its last slice */
+static void smallest_cycles_enqueue(l1_thread_info* thread) {
+  thread->heap_key = thread->total_time;
+  if (thread_heap_push(&get_scheduler()->run_heap, thread) != SUCCESS) {
+    fprintf(stderr, "Error: unable to grow the run queue.\n");
+    exit(-1);
+  }
+}
+
+static void heap_dequeue(l1_thread_info* thread) {
+  thread_heap_remove(&get_scheduler()->run_heap, thread);
+}
+
+l1_thread_info* l1_stride_policy(l1_thread_info* prev, l1_thread_info* next) {
+  if (next) return next;
+
+  return thread_heap_min(&get_scheduler()->run_heap);
+}
+
+/* Charges the time the thread ran since it was last queued to its pass */
+static void stride_enqueue(l1_thread_info* thread) {
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_time ran = thread->total_time - thread->stride_charged;
+
+  thread->pass += (ran * (STRIDE1 / thread->tickets)) >> STRIDE_TIME_SHIFT;
+  thread->stride_charged = thread->total_time;
+  if (thread->pass < scheduler->stride_pass) {
+    thread->pass = scheduler->stride_pass;
+  }
+  thread->heap_key = thread->pass;
+  if (thread_heap_push(&scheduler->run_heap, thread) != SUCCESS) {
+    fprintf(stderr, "Error: unable to grow the run queue.\n");
+    exit(-1);
   }
+}
+
+static void stride_dequeue(l1_thread_info* thread) {
+  l1_scheduler_info *scheduler = get_scheduler();
 
-  return thread_list_select_highest_priority(&scheduler->thread_arrays[RUNNABLE]);
+  thread_heap_remove(&scheduler->run_heap, thread);
+  scheduler->stride_pass = thread->pass;
 }
 
+l1_thread_info* l1_lottery_policy(l1_thread_info* prev, l1_thread_info* next) {
+  if (next) return next;
+
+  l1_thread_heap* heap = &get_scheduler()->run_heap;
+  uint64_t* rng = &get_scheduler()->lottery_rng;
+  uint64_t total = 0;
+
+  for (size_t i = 0; i < heap->size; ++i)
+    total += heap->threads[i]->tickets;
+  if (total == 0) {
+    return NULL;
+  }
+
+  /* xorshift64, never seeded with 0 */
+  if (*rng == 0) *rng = 0x9e3779b97f4a7c15ULL;
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+
+  uint64_t winner = *rng % total;
+  for (size_t i = 0; i < heap->size; ++i) {
+    if (winner < heap->threads[i]->tickets) {
+      return heap->threads[i];
+    }
+    winner -= heap->threads[i]->tickets;
+  }
+  return NULL;
+}
+
+/* The heap is only the set of runnable threads, in any order */
+static void lottery_enqueue(l1_thread_info* thread) {
+  thread->heap_key = 0;
+  if (thread_heap_push(&get_scheduler()->run_heap, thread) != SUCCESS) {
+    fprintf(stderr, "Error: unable to grow the run queue.\n");
+    exit(-1);
+  }
+}
+
+/* Weight of each nice level from L1_NICE_MIN, as in Linux */
+static const uint32_t cfs_weights[L1_NICE_MAX - L1_NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+l1_thread_info* l1_cfs_policy(l1_thread_info* prev, l1_thread_info* next) {
+  if (next) return next;
+
+  return thread_heap_min(&get_scheduler()->run_heap);
+}
+
+/* Charges the time the thread ran since it was last queued to its vruntime,
+ * and places waking threads near min_vruntime */
+static void cfs_enqueue(l1_thread_info* thread) {
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_time ran = thread->total_time - thread->cfs_charged;
+
+  if (ran > 0 && ran < CFS_MIN_GRANULARITY) {
+    ran = CFS_MIN_GRANULARITY;
+  }
+  thread->vruntime += ran * CFS_NICE0_WEIGHT / cfs_weights[thread->nice - L1_NICE_MIN];
+  thread->cfs_charged = thread->total_time;
+  /* Only changes threads which waited, the others are ahead of it */
+  if (scheduler->min_vruntime > CFS_SLEEPER_CREDIT &&
+      thread->vruntime < scheduler->min_vruntime - CFS_SLEEPER_CREDIT) {
+    thread->vruntime = scheduler->min_vruntime - CFS_SLEEPER_CREDIT;
+  }
+  thread->heap_key = thread->vruntime;
+  if (thread_heap_push(&scheduler->run_heap, thread) != SUCCESS) {
+    fprintf(stderr, "Error: unable to grow the run queue.\n");
+    exit(-1);
+  }
+}
+
+/* min_vruntime never goes back, and follows the smallest of the running
+ * thread and the waiting ones */
+static void cfs_dequeue(l1_thread_info* thread) {
+  l1_scheduler_info *scheduler = get_scheduler();
+  uint64_t vruntime = thread->vruntime;
+
+  thread_heap_remove(&scheduler->run_heap, thread);
+  l1_thread_info* leftmost = thread_heap_min(&scheduler->run_heap);
+  if (leftmost && leftmost->vruntime < vruntime) {
+    vruntime = leftmost->vruntime;
+  }
+  if (vruntime > scheduler->min_vruntime) {
+    scheduler->min_vruntime = vruntime;
+  }
+}
+
+l1_policy_queue l1_policy_queue_of(l1_thread_info* (*policy)(l1_thread_info*, l1_thread_info*)) {
+  l1_policy_queue queue = { NULL, NULL };
+
+  if (policy == l1_mlfq_policy) {
+    queue.enqueue = mlfq_enqueue;
+    queue.dequeue = mlfq_dequeue;
+  } else if (policy == l1_smallest_cycles_policy) {
+    queue.enqueue = smallest_cycles_enqueue;
+    queue.dequeue = heap_dequeue;
+  } else if (policy == l1_stride_policy) {
+    queue.enqueue = stride_enqueue;
+    queue.dequeue = stride_dequeue;
+  } else if (policy == l1_lottery_policy) {
+    queue.enqueue = lottery_enqueue;
+    queue.dequeue = heap_dequeue;
+  } else if (policy == l1_cfs_policy) {
+    queue.enqueue = cfs_enqueue;
+    queue.dequeue = cfs_dequeue;
+  }
+  return queue;
+}
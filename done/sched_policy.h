@@ -12,3 +12,72 @@ l1_thread_info* l1_round_robin_policy(l1_thread_info* prev, l1_thread_info* next
 l1_thread_info* l1_smallest_cycles_policy(l1_thread_info* prev, l1_thread_info* next);
 
 l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next);
+
+/* Tickets of a new thread, see `l1_thread_set_tickets` */
+#define L1_DEFAULT_TICKETS 100
+#define L1_MAX_TICKETS (1 << 16)
+/* Pass of a thread with one ticket after one ns << STRIDE_TIME_SHIFT */
+#define STRIDE1 (1 << 20)
+#define STRIDE_TIME_SHIFT 10
+
+/**
+ * @brief Stride scheduling: runs the thread with the smallest pass
+ *
+ * When a thread is descheduled, its pass advances by the time it ran times
+ * its stride, STRIDE1 / tickets, so threads get CPU time in proportion to
+ * their tickets. A thread which starts waiting for the CPU again gets at
+ * least the pass of the last thread dispatched, so time it spent blocked
+ * does not count as credit. Threads wait in a heap ordered by pass.
+ */
+l1_thread_info* l1_stride_policy(l1_thread_info* prev, l1_thread_info* next);
+
+/**
+ * @brief Lottery scheduling: runs a thread drawn at random, each with a
+ * chance proportional to its tickets
+ *
+ * Shares are proportional in number of picks, so in CPU time only for
+ * threads which run for as long each time. Draws are O(n) in the number of
+ * runnable threads.
+ */
+l1_thread_info* l1_lottery_policy(l1_thread_info* prev, l1_thread_info* next);
+
+/* Nice levels, see `l1_thread_set_nice` */
+#define L1_NICE_MIN (-20)
+#define L1_NICE_MAX 19
+/* Weight of a thread at nice 0 */
+#define CFS_NICE0_WEIGHT 1024
+/* Least run time charged for each time a thread runs */
+#define CFS_MIN_GRANULARITY (10 * L1_TIME_US)
+/* Most vruntime a waking thread may be behind min_vruntime */
+#define CFS_SLEEPER_CREDIT (3 * L1_TIME_MS)
+
+/**
+ * @brief Weighted fair scheduling: runs the thread with the smallest
+ * virtual runtime
+ *
+ * A thread's vruntime advances by the time it ran, at least
+ * CFS_MIN_GRANULARITY per run, times CFS_NICE0_WEIGHT / its weight. Each nice
+ * level is about 1.25 times less weight. The scheduler's min_vruntime
+ * follows the smallest vruntime of the running and waiting threads. New
+ * threads start at min_vruntime, and threads waking up (from a join, a
+ * sleep, I/O...) at most CFS_SLEEPER_CREDIT behind it, so that neither can
+ * monopolize the CPU. Threads wait in a heap ordered by vruntime.
+ */
+l1_thread_info* l1_cfs_policy(l1_thread_info* prev, l1_thread_info* next);
+
+/**
+ * @brief Hooks by which the scheduler keeps the run queue of a policy
+ *
+ * enqueue is called when a thread starts waiting for the CPU: it is
+ * created, unblocked, or descheduled while still runnable. dequeue is
+ * called when it is dispatched. Either may be NULL.
+ */
+typedef struct {
+  void (*enqueue)(l1_thread_info* thread);
+  void (*dequeue)(l1_thread_info* thread);
+} l1_policy_queue;
+
+/**
+ * @brief Returns the run queue hooks of a policy
+ */
+l1_policy_queue l1_policy_queue_of(l1_thread_info* (*policy)(l1_thread_info*, l1_thread_info*));
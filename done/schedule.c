@@ -4,15 +4,22 @@
  *
  * @author Mark Sutherland
  */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "preempt.h"
+#include "sched_mn.h"
 #include "schedule.h"
 #include "stack.h"
+#include "stack_stats.h"
 #include "thread.h"
 #include "l1_time.h"
+#include "wait_queue.h"
 
-l1_scheduler_info* scheduler = NULL; 
+/* Each M:N worker has its own scheduler */
+static L1_THREAD_LOCAL l1_scheduler_info* scheduler = NULL; 
 
 void initialize_scheduler(sched_policy policy) {
   scheduler = (l1_scheduler_info*) malloc(sizeof(l1_scheduler_info));
@@ -23,7 +30,6 @@ void initialize_scheduler(sched_policy policy) {
  
   /* Initialize scheduler */
   memset(scheduler, 0, sizeof(l1_scheduler_info)); 
-  scheduler->next_tid = 0;
   
   /* Create tsys */
   scheduler->tsys = malloc(sizeof(l1_thread_info));
@@ -36,9 +42,21 @@ void initialize_scheduler(sched_policy policy) {
   scheduler->tsys->id = -1;
   scheduler->current = scheduler->tsys;
   scheduler->tsys->yield_target = -1;
-  scheduler->tsys->thread_stack = malloc(sizeof(l1_stack));
+  scheduler->tsys->thread_stack = calloc(1, sizeof(l1_stack));
   scheduler->select_next = policy;
+  scheduler->queue = l1_policy_queue_of(policy);
   scheduler->sched_ticks = 0;
+  /* On a thread's segment, the calls of the scheduler into code without
+   * split-stack prologues go through __morestack: tsys is faster there */
+#ifdef L1_SPLIT_STACK
+  scheduler->direct_switch = false;
+#else
+  scheduler->direct_switch = true;
+#endif
+  reactor_init(&scheduler->reactor);
+  /* The TSC is calibrated once, before any thread runs */
+  l1_time_get_source();
+  timer_wheel_init(&scheduler->timers, l1_time_now_ns());
 }
 
 void clean_up_scheduler() {
@@ -50,6 +68,15 @@ void clean_up_scheduler() {
     free(scheduler->tsys->thread_stack);
     scheduler->tsys->thread_stack = NULL;
   }
+  l1_stack_free(scheduler->shared_stack);
+  scheduler->shared_stack = NULL;
+  /* Release the stacks kept for reuse */
+  l1_stack_cache_clear();
+  tid_table_free(&scheduler->tids);
+  thread_heap_free(&scheduler->run_heap);
+  thread_heap_free(&scheduler->edf_heap);
+  reactor_free(&scheduler->reactor);
+  l1_trace_stop();
   /* Free the scheduler */
   free(scheduler);
   scheduler = NULL;
@@ -60,7 +87,138 @@ l1_scheduler_info* get_scheduler() {
 }
 
 l1_tid get_uniq_tid(){
-  return scheduler->next_tid++;
+  if (scheduler->worker) {
+    return l1_mn_uniq_tid();
+  }
+  return tid_table_alloc(&scheduler->tids);
+}
+
+void release_uniq_tid(l1_tid tid) {
+  if (scheduler->worker) {
+    l1_mn_release_tid(tid);
+    return;
+  }
+  tid_table_release(&scheduler->tids, tid);
+}
+
+l1_thread_info* get_thread(l1_tid tid) {
+  return tid_table_find(&scheduler->tids, tid);
+}
+
+/* The thread starts waiting in the EDF heap or the run queue of the policy */
+static void enqueue(l1_thread_info* thread) {
+  if (thread->edf_deadline) {
+    thread->heap_key = thread->edf_deadline;
+    if (thread_heap_push(&scheduler->edf_heap, thread) != SUCCESS) {
+      fprintf(stderr, "Error: unable to grow the run queue.\n");
+      exit(-1);
+    }
+    return;
+  }
+  if (scheduler->queue.enqueue) {
+    scheduler->queue.enqueue(thread);
+  }
+}
+
+/* The thread leaves its run queue to run */
+static void dequeue(l1_thread_info* thread) {
+  if (thread->edf_deadline) {
+    thread_heap_remove(&scheduler->edf_heap, thread);
+    return;
+  }
+  if (scheduler->queue.dequeue) {
+    scheduler->queue.dequeue(thread);
+  }
+}
+
+/* Threads with a deadline run ahead of the policy's choice. The policy still
+ * sees prev, for its accounting. */
+static l1_thread_info* pick_next(l1_thread_info* prev, l1_thread_info* next) {
+  l1_thread_info* edf = thread_heap_min(&scheduler->edf_heap);
+  l1_thread_info* target = next;
+
+  next = scheduler->select_next(prev, next);
+  if (edf) next = edf;
+  /* Picking none makes tsys wait */
+  L1_TRACE(scheduler->trace, L1_TRACE_PICK, next ? next->id : (l1_tid)-1, prev->id,
+           edf ? L1_TRACE_PICK_EDF :
+           next && next == target ? L1_TRACE_PICK_YIELD : L1_TRACE_PICK_POLICY, 0);
+  return next;
+}
+
+void set_deadline(l1_thread_info* thread, uint64_t deadline) {
+  bool queued = thread->state == RUNNABLE;
+
+  if (queued) dequeue(thread);
+  thread->edf_deadline = deadline;
+  if (queued) enqueue(thread);
+}
+
+void wake_thread(l1_thread_info* thread) {
+  L1_TRACE(scheduler->trace, L1_TRACE_STATE, thread->id, -1, thread->state, RUNNABLE);
+  thread_list_remove(&scheduler->thread_arrays[thread->state], thread);
+  thread->state = RUNNABLE;
+  thread_list_add(&scheduler->thread_arrays[RUNNABLE], thread);
+  enqueue(thread);
+}
+
+/* A thread in IO_WAIT whose fd is ready */
+static void wake_io(l1_thread_info* thread) {
+  timer_wheel_remove(&scheduler->timers, thread);
+  wake_thread(thread);
+}
+
+/* A thread whose deadline passed: its sleep, I/O wait or join is over */
+static void expire_timer(l1_thread_info* thread) {
+  if (thread->state == IO_WAIT) {
+    reactor_cancel(&scheduler->reactor, thread);
+  } else if (thread->state == BLOCKED) {
+    l1_thread_info* joined = get_thread(thread->joined_target);
+
+    wait_queue_remove(&joined->joiners, thread);
+    thread->errno = ERRTIMEDOUT;
+    thread->joined_target = -1;
+  }
+  wake_thread(thread);
+}
+
+/* Waiting threads are checked once per period, so that runnable threads
+ * cannot starve them */
+static void check_waits_periodically(void) {
+  if (scheduler->sched_ticks != 0) {
+    return;
+  }
+  if (scheduler->timers.count > 0) {
+    timer_wheel_advance(&scheduler->timers, l1_time_now_ns(), expire_timer);
+  }
+  if (scheduler->reactor.waiting > 0) {
+    reactor_poll(&scheduler->reactor, 0, wake_io);
+  }
+}
+
+/* No thread can run: blocks until an fd is ready or the first deadline */
+static void wait_idle(void) {
+  uint64_t deadline = timer_wheel_next(&scheduler->timers);
+  uint64_t now = l1_time_now_ns();
+
+  if (scheduler->reactor.waiting > 0) {
+    int timeout = -1;
+
+    if (deadline != TIMER_WHEEL_NONE) {
+      /* In ms, rounded up */
+      uint64_t ms = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+      timeout = ms > INT_MAX ? INT_MAX : (int)ms;
+    }
+    reactor_poll(&scheduler->reactor, timeout, wake_io);
+  } else if (deadline != TIMER_WHEEL_NONE && deadline > now) {
+    struct timespec ts = { deadline / 1000000000ULL, deadline % 1000000000ULL };
+
+    /* Interrupted by a signal: the caller waits again */
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+  if (scheduler->timers.count > 0) {
+    timer_wheel_advance(&scheduler->timers, l1_time_now_ns(), expire_timer);
+  }
 }
 
 /* Put yourself on the tail of the associated scheduler queue*/
@@ -69,16 +227,92 @@ void add_to_scheduler(l1_thread_info* thread, l1_thread_state state) {
     fprintf(stderr, "Error: trying to add NULL to scheduler thread list!\n");
     exit(-1);
   }
+  if (scheduler->worker) {
+    l1_mn_add(thread);
+    return;
+  }
+  if (tid_table_insert(&scheduler->tids, thread) != SUCCESS) {
+    fprintf(stderr, "Error: unable to index a thread by ID!\n");
+    exit(-1);
+  }
+  L1_TRACE(scheduler->trace, L1_TRACE_CREATE, thread->id,
+           scheduler->current ? scheduler->current->id : (l1_tid)-1, 0, state);
   thread->prev = thread->next = NULL;
   thread->state = state;
   thread_list_add(&scheduler->thread_arrays[state], thread);
+  if (state == RUNNABLE) {
+    enqueue(thread);
+  }
+}
+
+/* Ends the slice of current. If it is still running, it goes back to the
+ * tail of the RUNNABLE list and its yield target is returned, if runnable. */
+static l1_thread_info* deschedule(l1_thread_info* current) {
+  l1_thread_info* next = NULL;
+  l1_tid target = current->yield_target;
+
+  /* Scheduler ticks */
+  // TODO check that it does not wrap?
+  scheduler->sched_ticks = (scheduler->sched_ticks+1) % SCHED_PERIOD;
+
+  /*Timestamp the end of slice*/
+  l1_time_get(&current->slice_end);
+  l1_time diff;
+  l1_time_diff(&diff, current->slice_end, current->slice_start);
+  l1_time_add(&current->total_time, diff);
+
+  /* Enforce non-global state */
+  scheduler->current = NULL;
+  current->errno = SUCCESS;
+  
+  if (current->state == RUNNING) {
+    L1_TRACE(scheduler->trace, L1_TRACE_STATE, current->id, -1, RUNNING, RUNNABLE);
+    current->state = RUNNABLE;
+    if (target != -1) {
+      next = get_thread(target);
+      if (next == NULL || next->state != RUNNABLE) {
+        next = NULL;
+        current->errno = ERRINVAL;
+      }
+    }
+    /* fake rotate the list. */
+    thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
+    thread_list_add(&scheduler->thread_arrays[RUNNABLE], current);
+    enqueue(current);
+  }
+  return next;
+}
+
+/* Makes next the running thread, ready to be switched to from prev */
+static void dispatch(l1_thread_info* prev, l1_thread_info* next) {
+  L1_TRACE(scheduler->trace, L1_TRACE_SWITCH, next->id, prev->id, 0, 0);
+  dequeue(next);
+  scheduler->current = next;
+  next->state = RUNNING;
+  next->got_scheduled = 1;
+  /*Make the thread the head of the list*/
+  thread_list_remove(&scheduler->thread_arrays[RUNNABLE], next);
+  thread_list_prepend(&scheduler->thread_arrays[RUNNABLE], next);
+  l1_time_init(&next->slice_end);
+  l1_time_get(&next->slice_start);
+  next->preempt_ticks = 0;
+  /* Copy a shared-stack thread back onto the shared stack */
+  if (!l1_stack_make_resident(next->thread_stack)) {
+    fprintf(stderr, "Error: unable to save a shared stack image.\n");
+    exit(-1);
+  }
 }
 
 /**
  * @brief always executes on tsys
  */
 void schedule() {
-  while(!thread_list_is_empty(&scheduler->thread_arrays[RUNNABLE])) {
+  /* tsys is not preempted, and frees threads with the allocators */
+  sig_atomic_t depth = l1_preempt_depth;
+
+  l1_preempt_depth = 1;
+  while(!thread_list_is_empty(&scheduler->thread_arrays[RUNNABLE]) ||
+        scheduler->reactor.waiting > 0 || scheduler->timers.count > 0) {
     if (scheduler == NULL || scheduler->current  == NULL) {
       fprintf(stderr, "Error: null pointer in scheduler logic.\n");
       exit(-1);
@@ -90,67 +324,46 @@ void schedule() {
       fprintf(stderr, "Error: bad handling of tsys\n");
       exit(-1);
     }
-    
-    /* Scheduler ticks */
-    // TODO check that it does not wrap?
-    scheduler->sched_ticks = (scheduler->sched_ticks+1) % SCHED_PERIOD;
 
     l1_thread_info* current = scheduler->current;
-    l1_thread_info* next = NULL;
-    l1_tid target = scheduler->current->yield_target;
-
-    /*Timestamp the end of slice*/
-    l1_time_get(&current->slice_end);
-    l1_time diff;
-    l1_time_diff(&diff, current->slice_end, current->slice_start);
-    l1_time_add(&current->total_time, diff);
-
-    /* Enforce non-global state */
-    scheduler->current = NULL;
-    current->errno = SUCCESS;
-    
-    if (current->state == RUNNING) {
-      current->state = RUNNABLE;
-      if (target != -1) {
-        next = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
-        if (next == NULL) {
-          current->errno = ERRINVAL;
-        }
-      }
-      /* fake rotate the list. */
-      thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
-      thread_list_add(&scheduler->thread_arrays[RUNNABLE], current);
-    }
+    l1_thread_info* next = deschedule(current);
 
     /* The thread is blocking */
     if (current != scheduler->tsys && 
-        (current->state == BLOCKED || current->state == ZOMBIE)) {
+        (current->state == BLOCKED || current->state == ZOMBIE ||
+         current->state == IO_WAIT || current->state == SLEEPING ||
+         current->state == WAITING)) {
       handle_non_runnable(current);
     }
+    check_waits_periodically();
     /* Give a chance to the scheduling algorithm to bypass yield*/
-    next = scheduler->select_next(current, next);
+    next = pick_next(current, next);
 
-    /* Now it is safe to free the thread if it is dead */
-    if (current->state == DEAD) {
-      l1_stack_free(current->thread_stack);
-      free(current);
-      current = NULL;
+    /* Now it is safe to free the dead threads */
+    while (!thread_list_is_empty(&scheduler->thread_arrays[DEAD])) {
+      l1_thread_info* dead = thread_list_pop(&scheduler->thread_arrays[DEAD]);
+      tid_table_remove(&scheduler->tids, dead->id);
+      tid_table_release(&scheduler->tids, dead->id);
+      l1_stack_free(dead->thread_stack);
+      free(dead);
+    }
+    current = NULL;
+
+    /* Only waiting threads are left */
+    while (next == NULL &&
+           (scheduler->reactor.waiting > 0 || scheduler->timers.count > 0)) {
+      wait_idle();
+      next = pick_next(scheduler->tsys, NULL);
     }
    
     /* Nothing to scheduler anymore.*/
     if (next == NULL) {
       break;
     }
-    scheduler->current = next;
-    next->state = RUNNING;
-    next->got_scheduled = 1;
-    /*Make the thread the head of the list*/
-    thread_list_remove(&scheduler->thread_arrays[RUNNABLE], next);
-    thread_list_prepend(&scheduler->thread_arrays[RUNNABLE], next);
-    l1_time_init(&next->slice_end);
-    l1_time_get(&next->slice_start);
-    switch_asm((uint64_t*)next->thread_stack->top, (uint64_t**)&scheduler->tsys->thread_stack->top);
+    dispatch(scheduler->tsys, next);
+    switch_stack(next->thread_stack, scheduler->tsys->thread_stack);
   }
+  l1_preempt_depth = depth;
   printf("Program terminating!\n"); 
 }
 
@@ -159,59 +372,60 @@ void handle_non_runnable(l1_thread_info* current) {
     fprintf(stderr, "Error: current is null in handle_non_runnable.\n");
     exit(-1);
   }
-  if (current->state != BLOCKED && current->state != ZOMBIE) {
+  if (current->state != BLOCKED && current->state != ZOMBIE &&
+      current->state != IO_WAIT && current->state != SLEEPING &&
+      current->state != WAITING) {
     fprintf(stderr, "Error: handle_non_runnable called  with invalid state.\n");
     exit(-1);
   }
+  L1_TRACE(scheduler->trace, L1_TRACE_STATE, current->id, -1, RUNNING, current->state);
 
   /* Move the thread to the appropriate list */
   thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
   thread_list_add(&scheduler->thread_arrays[current->state], current);
 
+  /* Already registered with what wakes it up: the reactor, the timer wheel
+   * or a wait queue of sync.h */
+  if (current->state == IO_WAIT || current->state == SLEEPING ||
+      current->state == WAITING) {
+    return;
+  }
+
   /* Thread called join */
   if (current->state == BLOCKED) {
     l1_tid target = current->joined_target;
+
+    L1_TRACE(scheduler->trace, L1_TRACE_JOIN, current->id, target, 0, 0);
     /* Invalid target */
     if (target == -1) {
       unblock_thread(current, NULL);
       return;
     }
 
-    /* Look for the target in zombie, runnable, and blocked lists */
-    l1_thread_info* joined = thread_list_find(&scheduler->thread_arrays[ZOMBIE], target);
-    if (joined != NULL) {
+    /* Look for the target among zombie, runnable, and blocked threads */
+    l1_thread_info* joined = get_thread(target);
+    if (joined != NULL && joined->state == ZOMBIE) {
       unblock_thread(current, joined);
       return;
     }
-    joined = thread_list_find(&scheduler->thread_arrays[BLOCKED], target);
-    if (joined != NULL) { 
-      return;
-    }
-    
-    joined = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
-    if (joined != NULL) { 
+    /* Wait in the target's queue of joiners until it finishes */
+    if (joined != NULL && joined->state != DEAD) { 
+      wait_queue_add(&joined->joiners, current);
       return;
     }
     unblock_thread(current, NULL);
     return;
   }
 
-  /* We are a zombie and need to unblock people. */
-  l1_thread_info* bl = scheduler->thread_arrays[BLOCKED].head;
-  l1_thread_info* joined = NULL;
-  while(bl != NULL) {
-    if (bl->joined_target == current->id) {
-      l1_thread_info* to_rm = bl;
-      if (joined == NULL) {
-        joined = to_rm;
-      } else {
-        unblock_thread(to_rm, NULL);
-      }
-    }
-    bl = bl->next;
-  }
-  if (joined != NULL) {
-   unblock_thread(joined, current);
+  /* Only retval is needed from a zombie, so its stack can already be reused */
+  l1_stack_stats_record(current);
+  l1_stack_free(current->thread_stack);
+  current->thread_stack = NULL;
+
+  /* We are a zombie and need to unblock people, they all get our retval. */
+  l1_thread_info* joiner;
+  while ((joiner = wait_queue_pop(&current->joiners)) != NULL) {
+    unblock_thread(joiner, current);
   }
 }
 
@@ -227,6 +441,10 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie) {
     fprintf(stderr, "Error: unblock_thread zombie thread invalid state\n");
     exit(-1);
   }
+  /* No timeout anymore, for l1_thread_join_timeout */
+  timer_wheel_remove(&scheduler->timers, blocked);
+  L1_TRACE(scheduler->trace, L1_TRACE_STATE, blocked->id, -1, BLOCKED, RUNNABLE);
+
   /* Spurious wake up */
   if (!zombie) {
     blocked->state = RUNNABLE;
@@ -234,6 +452,7 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie) {
     blocked->joined_target = -1;
     thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
     thread_list_add(&scheduler->thread_arrays[RUNNABLE], blocked);
+    enqueue(blocked);
     return;
   }
 
@@ -245,28 +464,96 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie) {
   blocked->joined_target = -1;
   thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
   thread_list_add(&scheduler->thread_arrays[RUNNABLE], blocked);
-  thread_list_remove(&scheduler->thread_arrays[ZOMBIE], zombie);
-  /* Mark as dead to free it in schedule */
-  zombie->state = DEAD;
+  enqueue(blocked);
+  /* The last joiner marks it as dead to free it in schedule */
+  if (wait_queue_is_empty(&zombie->joiners)) {
+    L1_TRACE(scheduler->trace, L1_TRACE_STATE, zombie->id, -1, ZOMBIE, DEAD);
+    thread_list_remove(&scheduler->thread_arrays[ZOMBIE], zombie);
+    zombie->state = DEAD;
+    thread_list_add(&scheduler->thread_arrays[DEAD], zombie);
+  }
 }
 
-void yield(l1_tid tid) {
-  /* Setup the target */
-  scheduler->current->yield_target = tid;
+/* Switches current out, it runs again when this returns */
+static void switch_out(l1_thread_info* current) {
+  /* The M:N worker decides from our state */
+  if (scheduler->worker) {
+    switch_stack(scheduler->tsys->thread_stack, current->thread_stack);
+    return;
+  }
+
+  /* A thread which stays runnable, or only waits for something to wake it up,
+   * picks the next thread on its own stack and switches to it directly.
+   * Joining and finished threads need tsys, and so does copying the shared
+   * stack a thread is running on. */
+  if (scheduler->direct_switch && current->thread_stack->shared == NULL &&
+      (current->state == RUNNING || current->state == WAITING ||
+       current->state == SLEEPING || current->state == IO_WAIT)) {
+    l1_thread_info* next = deschedule(current);
+
+    if (current->state != RUNNABLE) {
+      handle_non_runnable(current);
+    }
+    check_waits_periodically();
+    next = pick_next(current, next);
+    if (next == NULL && current->state == RUNNABLE) {
+      next = current;
+    }
+    if (next == NULL) {
+      /* Nothing can run: tsys waits, as if it had just run itself */
+      scheduler->current = scheduler->tsys;
+      switch_stack(scheduler->tsys->thread_stack, current->thread_stack);
+      return;
+    }
+    dispatch(current, next);
+    if (next != current) {
+      switch_stack(next->thread_stack, current->thread_stack);
+    }
+    return;
+  }
 
-  /* Always go back to tsys */
-  switch_asm((uint64_t*)scheduler->tsys->thread_stack->top,
-              (uint64_t**)&scheduler->current->thread_stack->top);
+  /* Go back to tsys */
+  switch_stack(scheduler->tsys->thread_stack, current->thread_stack);
   /* Nothing to do, we are rescheduled.  */
 }
 
+void yield(l1_tid tid) {
+  l1_thread_info* current = scheduler->current;
+  /* Switches are critical sections, and the thread switched to gets back
+   * the depth it had */
+  sig_atomic_t depth = l1_preempt_depth;
+
+  l1_preempt_depth = 1;
+  l1_preempt_pending = 0;
+
+  /* Setup the target */
+  current->yield_target = tid;
+  switch_out(current);
+  l1_preempt_depth = depth;
+}
+
+void yield_preempted(void) {
+  l1_thread_info* current = scheduler ? scheduler->current : NULL;
+
+  if (!current || current == scheduler->tsys) {
+    l1_preempt_pending = 0;
+    return;
+  }
+  l1_error saved = current->errno;
+  yield(-1);
+  current->errno = saved;
+}
 
-void switch_asm(uint64_t* dest, uint64_t** orig) {
-  asm volatile(
-      "mov %%rsp, (%[orig])\n"
-      "mov %[dest], %%rsp\n"
-      : /* No outputs */
-      : [orig] "r"(orig), [dest] "r"(dest)
-      : "rbx", "r12", "r13", "r14", "r15", "memory" /* clobbers */
-      ); 
+void switch_stack(l1_stack* dest, l1_stack* orig) {
+#ifdef L1_SPLIT_STACK
+  __splitstack_getcontext(orig->split_context);
+  __splitstack_setcontext(dest->split_context);
+#endif
+  /* Coroutines also switch without a scheduler */
+  if (scheduler) scheduler->switches++;
+#ifdef L1_SWITCH_FP
+  switch_asm_fp(dest->top, &orig->top);
+#else
+  switch_asm(dest->top, &orig->top);
+#endif
 }
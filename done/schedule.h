@@ -5,8 +5,15 @@
  * @author Mark Sutherland
  */
 #pragma once
+#include "reactor.h"
+#include "run_queue.h"
+#include "sched_policy.h"
+#include "thread_heap.h"
 #include "thread_info.h"
 #include "thread_list.h"
+#include "tid_table.h"
+#include "timer_wheel.h"
+#include "trace.h"
 
 /* Week 4: Interface for scheduling */
 typedef l1_thread_info* (*sched_policy) (l1_thread_info*, l1_thread_info*);
@@ -16,11 +23,26 @@ typedef l1_thread_info* (*sched_policy) (l1_thread_info*, l1_thread_info*);
 
 typedef struct {
   l1_thread_info* current;                          /** Current thread */
-  l1_tid next_tid;                                  /** Next thread */
   l1_thread_info* tsys;                             /** System thread */
   sched_policy select_next;                         /** Scheduler policy */
+  l1_policy_queue queue;                            /** Run queue hooks of the policy */
   l1_thread_list thread_arrays[NUM_THREAD_STATES];  /** Lists for the threads in different states. */
+  l1_run_queue run_queue;                           /** MLFQ: threads waiting for the CPU, by priority */
+  l1_thread_heap run_heap;                          /** Threads waiting for the CPU, by policy key */
+  l1_tid_table tids;                                /** Threads which are not reaped, by ID */
   uint64_t sched_ticks;                             /** Scheduler ticks */
+  l1_stack* shared_stack;                           /** Stack of shared-stack threads */
+  bool direct_switch;                               /** Yield without going through tsys, off with split stacks */
+  uint64_t switches;                                /** Number of context switches */
+  struct l1_worker* worker;                         /** M:N worker, NULL if not in M:N mode */
+  l1_reactor reactor;                               /** Threads in IO_WAIT */
+  l1_timer_wheel timers;                            /** Threads waiting with a deadline */
+  l1_thread_heap edf_heap;                          /** Threads with a deadline waiting for the CPU */
+  l1_deadline_stats deadline_stats;                 /** Jobs and misses of all the threads */
+  uint64_t stride_pass;                             /** Stride: pass of the last thread dispatched */
+  uint64_t lottery_rng;                             /** Lottery: state of the draws */
+  uint64_t min_vruntime;                            /** CFS: smallest vruntime, never decreasing */
+  l1_trace_ring* trace;                             /** Events, NULL if tracing is off, see trace.h */
 } l1_scheduler_info;
 
 /**
@@ -39,10 +61,23 @@ void clean_up_scheduler();
 l1_scheduler_info* get_scheduler();
 
 /**
- * @brief Generate unique TIDs by incrementing scheduler variable 
+ * @brief Generate unique TIDs, reusing the ones of reaped threads
+ *
+ * Returns -1 if there are TID_MAX_THREADS threads already.
  */
 l1_tid get_uniq_tid();
 
+/**
+ * @brief Makes a TID from `get_uniq_tid` which was not used reusable
+ */
+void release_uniq_tid(l1_tid tid);
+
+/**
+ * @brief Returns the thread with ID tid, NULL if it does not exist or was
+ * reaped
+ */
+l1_thread_info* get_thread(l1_tid tid);
+
 /**
  * @brief Adds a thread to the scheduler data structure in an associated
  * state.
@@ -53,12 +88,17 @@ void add_to_scheduler(l1_thread_info* thread, l1_thread_state state);
  * @brief The scheduler's main loop logic.
  *
  * This function is called by tsys and simulates a kernel scheduler.
- * tsys runs this loop as long as the runnable list is not empty.
+ * tsys runs this loop as long as the runnable list is not empty, or threads
+ * wait for I/O or a deadline. When no thread can run, it blocks until the
+ * first of them can; it also checks for them without blocking every
+ * SCHED_PERIOD ticks.
  * The main loop logic is as follows: 
  * 1. Check the currently scheduled thread. If it has a yield target,
  * find the corresponding thread.
  * 2. If the current thread state is non-runnable, deschedule it.
- * 3. If the yield target is undefined, call the scheduler's select_next method.
+ * 3. If a thread with a deadline waits for the CPU, pick the one with the
+ * earliest deadline. Otherwise, if the yield target is undefined, call the
+ * scheduler's select_next method.
  * 4. Change the state of the current thread.
  * 5. Schedule the next thread.
  * 6. Switch from tsys to the next thread.
@@ -66,6 +106,21 @@ void add_to_scheduler(l1_thread_info* thread, l1_thread_state state);
  */
 void schedule();
 
+/**
+ * @brief Moves a thread which waited for something (I/O, a deadline, a
+ * mutex...) back to the RUNNABLE list and the run queue of the policy
+ *
+ * @warning The thread must be in the list of its state, so it must have
+ * gone through `handle_non_runnable`.
+ */
+void wake_thread(l1_thread_info* thread);
+
+/**
+ * @brief Sets the absolute deadline of a thread, 0 to leave the EDF class,
+ * and moves it to the matching run queue if it waits for the CPU
+ */
+void set_deadline(l1_thread_info* thread, uint64_t deadline);
+
 /**
  * @brief handles cleanup for dead threads and joins
  */
@@ -77,7 +132,7 @@ void handle_non_runnable(l1_thread_info* current);
  * This is a helper function that assumes blocked is in the BLOCKED list
  * and zombie is in ZOMBIE list or null. The function moves blocked
  * to the RUNNABLE list. If zombie is not null, it */
- // puts zombie into dead mode.
+ // puts zombie into dead mode, once its other joiners are woken up.
  // The free of the zombie happens in schedule.
  /**
  * @warning The function changes errno value for a l1_thread_info and moves 
@@ -99,18 +154,65 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie);
  * 
  * The function will resume from this point at some later point in time as
  * decide by the scheduler (may be immediately).
+ *
+ * If the thread is still running, or waits in the WAITING, SLEEPING or
+ * IO_WAIT state, and `direct_switch` is set, the yielding thread runs the
+ * scheduler's `select_next` itself and switches straight to the selected
+ * thread. Otherwise, if the thread joins or finished, or if no thread can
+ * run, it switches to tsys, which runs `schedule`. `direct_switch` is set
+ * by default, except with SPLIT_STACK=1: running the scheduler on the small
+ * segment of a thread costs more than the switch to tsys it saves.
  * 
- * yield(-1) yields to the system thread
+ * yield(-1) lets the scheduler policy pick the next thread
  */
 void yield(l1_tid next);
 
+/**
+ * @brief yield(-1) from the preemption signal handler, see preempt.h
+ *
+ * The errno of the thread is kept, since the thread may be preempted between
+ * a yield and reading it.
+ */
+void yield_preempted(void);
+
+/* Functions running while the stack limit does not match the current stack
+ * must not check it in their prologue */
+#ifdef L1_SPLIT_STACK
+#define L1_NO_SPLIT_STACK __attribute__((no_split_stack))
+#else
+#define L1_NO_SPLIT_STACK
+#endif
+
+/**
+ * @brief switch_stack saves the current context in orig, and switches to
+ * the context saved in dest.
+ *
+ * In segmented-stack mode, this also saves the split-stack context of orig
+ * and installs the one of dest before calling switch_asm.
+ */
+void switch_stack(l1_stack* dest, l1_stack* orig) L1_NO_SPLIT_STACK;
+
 /**
  * @brief switch_asm saves the current stack state in orig, and switches
  * to dest stack.
  *
- * This function is a small inlined assembly code that saves the scratch
- * registers rbx, r12, r13, r14, r15 on the current stack, saves the current
- * stack register into orig, and switches to dest. 
+ * This function is a standalone assembly routine (switch.S) that pushes the
+ * callee-saved registers rbp, r15, r14, r13, r12, rbx on the current stack,
+ * saves the current stack register into orig, and switches to dest. 
  * The asm will pop the dest's saved registers and return.
  */
-void switch_asm(uint64_t* dest, uint64_t** orig); 
+void switch_asm(uint64_t* dest, uint64_t** orig);
+
+/**
+ * @brief switch_asm_fp is switch_asm, but also saves and restores the MXCSR
+ * and x87 control words, in one extra word below rbx.
+ *
+ * The scheduler uses it instead of switch_asm when built with
+ * `make SWITCH_FP=1`, for threads which change the floating-point rounding
+ * or exception modes.
+ */
+void switch_asm_fp(uint64_t* dest, uint64_t** orig);
+
+/* Floating-point control word a new thread starts with in SWITCH_FP mode:
+ * default x87 control word (0x037f) above default MXCSR (0x1f80) */
+#define SWITCH_FP_DEFAULT_CONTROL ((0x037fULL << 32) | 0x1f80ULL)
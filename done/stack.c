@@ -6,27 +6,271 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "error.h"
 #include "stack.h"
 
+static bool stack_watermarking = false;
+
+void l1_stack_set_watermarking(bool enabled) {
+  stack_watermarking = enabled;
+}
+
+/* Fills a new stack with the watermark pattern if watermarking is on */
+static void l1_stack_watermark_fill(l1_stack* thread_stack) {
+  thread_stack->watermarked = stack_watermarking;
+  if (!stack_watermarking)
+    return;
+  for (uint64_t* word = thread_stack->base; word < thread_stack->top; ++word)
+    *word = STACK_WATERMARK_PATTERN;
+}
+
+size_t l1_stack_high_watermark(l1_stack* thread_stack) {
+  if (thread_stack == NULL || !thread_stack->watermarked)
+    return 0;
+
+  /* The stack grows down: the lowest overwritten word is the deepest used */
+  uint64_t* end = thread_stack->base + thread_stack->capacity;
+  uint64_t* word = thread_stack->base;
+  while (word < end && *word == STACK_WATERMARK_PATTERN)
+    ++word;
+  return (end - word) * sizeof(uint64_t);
+}
+
+#ifdef L1_SPLIT_STACK
 l1_stack* l1_stack_new(void) {
-  l1_stack* l1_stack_new = (l1_stack*)malloc(sizeof(l1_stack));
+  return l1_stack_new_sized(STACK_SIZE);
+}
+
+l1_stack* l1_stack_new_sized(size_t size) {
+  if (size > STACK_MAX_SIZE)
+    return NULL;
+
+  /* The size is not reserved up front: the first segment grows on demand */
+  l1_stack* l1_stack_new = (l1_stack*)calloc(1, sizeof(l1_stack));
   if( l1_stack_new == NULL ) 
     return NULL;
-  l1_stack_new->capacity = MAX_STACK_CAPACITY;
+  size_t segment_size;
+  l1_stack_new->base = __splitstack_makecontext(SPLIT_STACK_SEGMENT_SIZE,
+                                                l1_stack_new->split_context, &segment_size);
+  if( l1_stack_new->base == NULL ) {
+    free(l1_stack_new);
+    return NULL;
+  }
+  l1_stack_new->capacity = segment_size / sizeof(uint64_t);
   l1_stack_new->size = 0;
+  l1_stack_new->next = NULL;
+  /* Point top to last element in the stack */
+  l1_stack_new->top = l1_stack_new->base + (l1_stack_new->capacity);
+  /* Only the first segment is measured */
+  l1_stack_watermark_fill(l1_stack_new);
+  return l1_stack_new;
+}
+
+void l1_stack_free(l1_stack* thread_stack) {
+  if (thread_stack == NULL)
+    return;
+
+  /* Segments are owned by libgcc, release all of them at once */
+  __splitstack_releasecontext(thread_stack->split_context);
+  free(thread_stack);
+}
+
+void l1_stack_cache_clear(void) {
+  /* Nothing is cached: segments are released along with their context */
+}
+
+l1_stack* l1_shared_stack_new(void) {
+  /* Copying a stack would not copy the segments linked below it */
+  return NULL;
+}
+#else
+/* The pool of cached stacks of one size class */
+typedef struct {
+  unsigned count;     /** Number of cached stacks */
+  l1_stack *head;     /** First cached stack */
+} l1_stack_pool;
+
+/* One set of pools per OS thread, so that M:N workers need no lock */
+static L1_THREAD_LOCAL l1_stack_pool stack_pools[STACK_NUM_CLASSES];
+
+/* Size in bytes of the stacks of a class */
+static size_t l1_stack_class_size(int cls) {
+  return (size_t)STACK_MIN_SIZE << (2 * cls);
+}
+
+/* Returns the smallest class of at least size bytes, or -1 if too large */
+static int l1_stack_size_class(size_t size) {
+  for (int cls = 0; cls < STACK_NUM_CLASSES; ++cls) {
+    if (size <= l1_stack_class_size(cls))
+      return cls;
+  }
+  return -1;
+}
+
+/* Unmaps the stack region and its guard page, and frees the struct */
+static void l1_stack_unmap(l1_stack* thread_stack) {
+  munmap((char*)thread_stack->base - STACK_GUARD_SIZE,
+         STACK_GUARD_SIZE + thread_stack->capacity * sizeof(uint64_t));
+  free(thread_stack);
+}
+
+/* Maps a stack of stack_size bytes, with a guard page below it */
+static l1_stack* l1_stack_map(size_t stack_size) {
+  l1_stack* l1_stack_new = (l1_stack*)calloc(1, sizeof(l1_stack));
+  if( l1_stack_new == NULL ) 
+    return NULL;
+  l1_stack_new->capacity = stack_size / sizeof(uint64_t);
+  /* Reserve the guard page and the stack in one lazily committed mapping */
+  char* region = mmap(NULL, STACK_GUARD_SIZE + stack_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if( region == MAP_FAILED ) {
+    free(l1_stack_new);
+    return NULL;
+  }
+  /* The stack grows down, so the guard page goes below the base */
+  if( mprotect(region, STACK_GUARD_SIZE, PROT_NONE) != 0 ) {
+    munmap(region, STACK_GUARD_SIZE + stack_size);
+    free(l1_stack_new);
+    return NULL;
+  }
+  l1_stack_new->base = (uint64_t*)(region + STACK_GUARD_SIZE);
+  /* Point top to last element in the stack */
+  l1_stack_new->top = l1_stack_new->base + (l1_stack_new->capacity);
+  return l1_stack_new;
+}
+
+l1_stack* l1_stack_new(void) {
+  return l1_stack_new_sized(STACK_SIZE);
+}
+
+l1_stack* l1_stack_new_sized(size_t size) {
+  int cls = l1_stack_size_class(size);
+  l1_stack* l1_stack_new;
+
+  if (cls < 0)
+    return NULL;
+
+  /* Reuse a cached stack, its top page is still committed */
+  l1_stack_pool* pool = &stack_pools[cls];
+  if (pool->head != NULL) {
+    l1_stack_new = pool->head;
+    pool->head = l1_stack_new->next;
+    pool->count--;
+    l1_stack_new->size = 0;
+    l1_stack_new->next = NULL;
+    l1_stack_new->top = l1_stack_new->base + (l1_stack_new->capacity);
+  } else {
+    l1_stack_new = l1_stack_map(l1_stack_class_size(cls));
+    if (l1_stack_new == NULL)
+      return NULL;
+  }
+
+  l1_stack_watermark_fill(l1_stack_new);
+  return l1_stack_new;
+}
+
+l1_stack* l1_shared_stack_new(void) {
+  return l1_stack_map(SHARED_STACK_SIZE);
+}
+
+void l1_stack_free(l1_stack* thread_stack) {
+  if (thread_stack == NULL)
+    return;
+
+  /* A shared-stack thread only owns its image */
+  if (thread_stack->shared != NULL) {
+    if (thread_stack->resident)
+      thread_stack->shared->owner = NULL;
+    else
+      free(thread_stack->base);
+    free(thread_stack);
+    return;
+  }
+
+  /* The capacity tells which pool the stack belongs to */
+  size_t size = thread_stack->capacity * sizeof(uint64_t);
+  int cls = l1_stack_size_class(size);
+  if (cls < 0 || l1_stack_class_size(cls) != size ||
+      stack_pools[cls].count >= STACK_CACHE_DEPTH) {
+    l1_stack_unmap(thread_stack);
+    return;
+  }
+  /* The pages stay mapped, and read as zeros when touched again */
+  madvise(thread_stack->base, size - STACK_CACHE_KEEP_SIZE, MADV_DONTNEED);
+  thread_stack->next = stack_pools[cls].head;
+  stack_pools[cls].head = thread_stack;
+  stack_pools[cls].count++;
+}
+
+void l1_stack_cache_clear(void) {
+  for (int i = 0; i < STACK_NUM_CLASSES; ++i) {
+    while (stack_pools[i].head != NULL) {
+      l1_stack* cached = stack_pools[i].head;
+      stack_pools[i].head = cached->next;
+      l1_stack_unmap(cached);
+    }
+    stack_pools[i].count = 0;
+  }
+}
+#endif
+
+l1_stack* l1_stack_new_on_shared(l1_stack* shared) {
+  l1_stack* l1_stack_new = (l1_stack*)calloc(1, sizeof(l1_stack));
+  if( l1_stack_new == NULL ) 
+    return NULL;
+  l1_stack_new->capacity = SHARED_STACK_START_CAPACITY;
   l1_stack_new->base = (uint64_t*)malloc(l1_stack_new->capacity * sizeof(uint64_t));
   if( l1_stack_new->base == NULL ) {
     free(l1_stack_new);
     return NULL;
   }
+  l1_stack_new->shared = shared;
   /* Point top to last element in the stack */
   l1_stack_new->top = l1_stack_new->base + (l1_stack_new->capacity);
   return l1_stack_new;
 }
 
-void l1_stack_free(l1_stack* thread_stack) {
+/* Copies the live part of a resident stack into a buffer of the exact size */
+static bool l1_stack_save(l1_stack* thread_stack) {
+  l1_stack* shared = thread_stack->shared;
+  /* switch_asm only updated top, so recompute the used space */
+  unsigned size = shared->base + shared->capacity - thread_stack->top;
+  uint64_t* image = (uint64_t*)malloc(size * sizeof(uint64_t));
+
+  if (image == NULL)
+    return false;
+  memcpy(image, thread_stack->top, size * sizeof(uint64_t));
+
+  thread_stack->capacity = thread_stack->size = size;
+  thread_stack->base = thread_stack->top = image;
+  thread_stack->resident = false;
+  shared->owner = NULL;
+  return true;
+}
+
+bool l1_stack_make_resident(l1_stack* thread_stack) {
+  l1_stack* shared = thread_stack->shared;
+
+  if (shared == NULL || thread_stack->resident)
+    return true;
+  if (shared->owner != NULL && !l1_stack_save(shared->owner))
+    return false;
+
+  /* The image holds the words from top to the end of the buffer */
+  unsigned size = thread_stack->base + thread_stack->capacity - thread_stack->top;
+  uint64_t* top = shared->base + shared->capacity - size;
+  memcpy(top, thread_stack->top, size * sizeof(uint64_t));
   free(thread_stack->base);
-  free(thread_stack);
+
+  thread_stack->capacity = shared->capacity;
+  thread_stack->size = size;
+  thread_stack->base = shared->base;
+  thread_stack->top = top;
+  thread_stack->resident = true;
+  shared->owner = thread_stack;
+  return true;
 }
 
 bool l1_stack_is_full(l1_stack* thread_stack) {
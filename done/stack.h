@@ -6,40 +6,192 @@
  */
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Each thread reserves a stack of STACK_SIZE bytes with mmap. Pages are only
+ * committed by the kernel when first touched, so a thread's RSS follows its
+ * actual stack use. A PROT_NONE guard page of STACK_GUARD_SIZE bytes sits
+ * right below the stack, so an overflow faults instead of silently corrupting
+ * a neighbouring mapping. */
+#define STACK_SIZE          (256 * 1024)
+#define STACK_GUARD_SIZE    (4 * 1024)
+
+/* Stack sizes come in STACK_NUM_CLASSES classes, from STACK_MIN_SIZE bytes
+ * and 4 times larger for each class up to STACK_MAX_SIZE. STACK_SIZE is one
+ * of the classes. */
+#define STACK_NUM_CLASSES   4
+#define STACK_MIN_SIZE      (16 * 1024)
+#define STACK_MAX_SIZE      (STACK_MIN_SIZE << (2 * (STACK_NUM_CLASSES - 1)))
+
 /* Each thread allocates a stack of capacity = MAX_STACK_CAPACITY words
  * On a 64-bit architecture, a word is 64 bits */
-#define MAX_STACK_CAPACITY  1024
+#define MAX_STACK_CAPACITY  (STACK_SIZE / sizeof(uint64_t))
+
+#ifdef L1_SPLIT_STACK
+/* Segmented-stack mode (`make SPLIT_STACK=1`). Code is compiled with
+ * -fsplit-stack, so every function prologue checks the stack limit and calls
+ * libgcc's __morestack to link a new segment when the current one is too
+ * small. A thread starts on one segment of SPLIT_STACK_SEGMENT_SIZE bytes.
+ * libgcc keeps each thread's segment list and stack limit in a split-stack
+ * context, which the scheduler swaps on every context switch. */
+#define SPLIT_STACK_SEGMENT_SIZE  (8 * 1024)
+#define SPLIT_STACK_CONTEXT_SIZE  10
+
+/* libgcc split-stack context API, see libgcc/generic-morestack.c */
+void *__splitstack_makecontext(size_t, void *[SPLIT_STACK_CONTEXT_SIZE], size_t *);
+void __splitstack_getcontext(void *[SPLIT_STACK_CONTEXT_SIZE]);
+void __splitstack_setcontext(void *[SPLIT_STACK_CONTEXT_SIZE]);
+void __splitstack_releasecontext(void *[SPLIT_STACK_CONTEXT_SIZE]);
+#endif
+
+/* Shared-stack threads all execute on one shared stack of SHARED_STACK_SIZE
+ * bytes. While a shared-stack thread is not resident on it, only the live
+ * part of its stack is kept, in a right-sized heap buffer (its "image"). */
+#define SHARED_STACK_SIZE   (1024 * 1024)
+/* Room for the initial frame of a shared-stack thread, in words */
+#define SHARED_STACK_START_CAPACITY  16
+
+/* In watermarking mode, new stacks are filled with STACK_WATERMARK_PATTERN,
+ * so the deepest word a thread used can be found later */
+#define STACK_WATERMARK_PATTERN 0x57a7c0ffee57a7c0ULL
+
+/* Freed stacks are kept for reuse in one pool per size class. Each pool
+ * keeps at most STACK_CACHE_DEPTH stacks, the rest are unmapped. A cached
+ * stack gives its pages back to the kernel, except for the top
+ * STACK_CACHE_KEEP_SIZE bytes the next thread starts on, so the pools hold
+ * address space rather than RSS. */
+#define STACK_CACHE_DEPTH   1024
+#define STACK_CACHE_KEEP_SIZE  (4 * 1024)
 
 /**
  * @brief A stack structure
  */
-typedef struct {
+typedef struct l1_stack {
   unsigned capacity;  /** Capacity of the stack (in 64-bit chunks) */
   unsigned size;      /** Used space in the stack */
   uint64_t *top;      /** Pointer to the "top" of the stack */
   uint64_t *base;     /** Pointer to the base of the allocated region */
+  struct l1_stack *next;  /** Next free stack in the cache pool */
+  struct l1_stack *shared;  /** Shared stack this stack runs on, NULL if private */
+  struct l1_stack *owner;   /** For a shared stack: the resident stack */
+  bool resident;            /** Whether this stack is on its shared stack */
+  bool watermarked;         /** Whether the stack was filled with the pattern */
+#ifdef L1_SPLIT_STACK
+  void *split_context[SPLIT_STACK_CONTEXT_SIZE];  /** libgcc segment context */
+#endif
 } l1_stack;
 
 /**
  * @brief Creates a new stack for a thread
  *
  * This function allocates space for and sets up a new stack of type 
- * `l1_stack` and of capacity MAX_STACK_CAPACITY.
+ * `l1_stack` and of capacity MAX_STACK_CAPACITY. The stack memory is an
+ * anonymous mapping preceded by a guard page. A cached stack of the same
+ * capacity is reused if there is one.
+ *
+ * In segmented-stack mode, the stack is instead the first segment of a new
+ * split-stack context, and `capacity` is the size of that segment.
  *
  * @return  A pointer to the allocated stack. Returns NULL if unable
  *          to allocate space for the stack
  */
 l1_stack* l1_stack_new(void);
 
+/**
+ * @brief Creates a new stack of a given size class
+ *
+ * Same as `l1_stack_new`, but the stack is at least size bytes long: the
+ * size is rounded up to the next size class, and `capacity` records the
+ * size of that class. Cached stacks are taken from the pool of the class.
+ *
+ * In segmented-stack mode, stacks grow on demand and size is only checked
+ * against STACK_MAX_SIZE.
+ *
+ * @param   size  The minimum size of the stack, in bytes
+ * @return  A pointer to the allocated stack. Returns NULL if size is larger
+ *          than STACK_MAX_SIZE or if unable to allocate space for the stack
+ */
+l1_stack* l1_stack_new_sized(size_t size);
+
 /**
  * @brief Cleans up the stack for a thread on completion 
+ *
+ * The stack goes back to the pool of its size class, unless the pool is full.
+ * Passing NULL does nothing.
  * 
  * @param   thread_stack A pointer to the stack to be freed
  */
 void l1_stack_free(l1_stack* thread_stack);
 
+/**
+ * @brief Unmaps all the stacks held in the cache
+ */
+void l1_stack_cache_clear(void);
+
+/**
+ * @brief Creates a shared execution stack
+ *
+ * The shared stack is mapped like a thread stack, with a guard page, but is
+ * SHARED_STACK_SIZE bytes long. Shared stacks are not available in
+ * segmented-stack mode.
+ *
+ * @return  A pointer to the shared stack, or NULL on failure
+ */
+l1_stack* l1_shared_stack_new(void);
+
+/**
+ * @brief Creates a stack for a thread running on a shared stack
+ *
+ * The new stack starts as an empty image of SHARED_STACK_START_CAPACITY
+ * words, so its initial frame can be pushed as on a private stack. It is
+ * copied to the shared stack by `l1_stack_make_resident`.
+ *
+ * @param   shared  The shared stack the thread will run on
+ * @return  A pointer to the allocated stack. Returns NULL if unable
+ *          to allocate space for the stack
+ */
+l1_stack* l1_stack_new_on_shared(l1_stack* shared);
+
+/**
+ * @brief Makes a stack resident on its shared stack
+ *
+ * If another stack is resident, the live part of that stack, from its top
+ * to the end of the shared stack, is first saved into a heap buffer of the
+ * exact size. The image of thread_stack is then copied to the end of the
+ * shared stack. Nothing is copied if thread_stack is private or already
+ * resident.
+ *
+ * @warning Must not run on the shared stack itself.
+ *
+ * @param   thread_stack  The stack about to be switched to
+ * @return  false if the resident stack could not be saved
+ */
+bool l1_stack_make_resident(l1_stack* thread_stack);
+
+/**
+ * @brief Turns watermarking of new stacks on or off
+ *
+ * While on, `l1_stack_new` and `l1_stack_new_sized` fill every stack with
+ * STACK_WATERMARK_PATTERN. This commits all the pages of the stack, so it
+ * is meant for measuring stack use, not for production runs.
+ *
+ * @param   enabled Whether new stacks are filled with the pattern
+ */
+void l1_stack_set_watermarking(bool enabled);
+
+/**
+ * @brief Returns the most stack space a thread has used so far
+ *
+ * Scans the stack from its base for the first word which no longer holds the
+ * pattern. In segmented-stack mode, only the first segment is measured.
+ *
+ * @param   thread_stack  The stack to measure
+ * @return  The high-watermark in bytes, or 0 if the stack was not filled
+ *          with the pattern (e.g. shared-stack images)
+ */
+size_t l1_stack_high_watermark(l1_stack* thread_stack);
+
 /**
  * @brief Check if the stack is full 
  *
@@ -0,0 +1,102 @@
+/**
+ * @file stack_stats.c
+ * @brief Implementation of the stack use statistics
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <string.h>
+#include "schedule.h"
+#include "stack_stats.h"
+
+static l1_stack_stats stack_stats[STACK_STATS_MAX_FUNCS];
+static unsigned stack_stats_num = 0;
+
+/* Returns the statistics of func, adding them if there is room */
+static l1_stack_stats* l1_stack_stats_get(thread_func_t func) {
+  for (unsigned i = 0; i < stack_stats_num; ++i) {
+    if (stack_stats[i].func == func)
+      return &stack_stats[i];
+  }
+  if (stack_stats_num == STACK_STATS_MAX_FUNCS)
+    return NULL;
+  memset(&stack_stats[stack_stats_num], 0, sizeof(l1_stack_stats));
+  stack_stats[stack_stats_num].func = func;
+  return &stack_stats[stack_stats_num++];
+}
+
+/* Prints the symbol name of func if it can be found, its address otherwise */
+static void l1_stack_stats_print_func(FILE* out, thread_func_t func) {
+  Dl_info info;
+  void* addr = (void*)(uintptr_t)func;
+  if (dladdr(addr, &info) && info.dli_sname != NULL)
+    fprintf(out, "%s", info.dli_sname);
+  else
+    fprintf(out, "%p", addr);
+}
+
+void l1_stack_stats_record(l1_thread_info* thread) {
+  if (thread == NULL || thread->thread_stack == NULL || !thread->thread_stack->watermarked)
+    return;
+
+  l1_stack_stats* stats = l1_stack_stats_get(thread->thread_func);
+  if (stats == NULL)
+    return;
+
+  size_t watermark = l1_stack_high_watermark(thread->thread_stack);
+  unsigned bucket = 0;
+  while (bucket < STACK_STATS_BUCKETS - 1 && 
+         watermark >= ((size_t)STACK_STATS_MIN_BUCKET << bucket))
+    ++bucket;
+
+  stats->threads++;
+  stats->histogram[bucket]++;
+  if (watermark > stats->max)
+    stats->max = watermark;
+}
+
+const l1_stack_stats* l1_stack_stats_find(thread_func_t func) {
+  for (unsigned i = 0; i < stack_stats_num; ++i) {
+    if (stack_stats[i].func == func)
+      return &stack_stats[i];
+  }
+  return NULL;
+}
+
+void l1_stack_stats_report(FILE* out) {
+  l1_scheduler_info* scheduler = get_scheduler();
+
+  fprintf(out, "Stack high-watermarks of live threads:\n");
+  /* Zombies have already released their stack */
+  for (l1_thread_state state = RUNNING; scheduler && state < ZOMBIE; ++state) {
+    for (l1_thread_info* cur = scheduler->thread_arrays[state].head; cur != NULL; cur = cur->next) {
+      if (cur->thread_stack == NULL || !cur->thread_stack->watermarked)
+        continue;
+      fprintf(out, "  tid %u (", cur->id);
+      l1_stack_stats_print_func(out, cur->thread_func);
+      fprintf(out, "): %zu of %zu bytes\n", l1_stack_high_watermark(cur->thread_stack),
+              cur->thread_stack->capacity * sizeof(uint64_t));
+    }
+  }
+
+  fprintf(out, "Stack high-watermarks per thread function:\n");
+  for (unsigned i = 0; i < stack_stats_num; ++i) {
+    l1_stack_stats* stats = &stack_stats[i];
+    fprintf(out, "  ");
+    l1_stack_stats_print_func(out, stats->func);
+    fprintf(out, ": %lu threads, max %zu bytes\n", stats->threads, stats->max);
+    for (unsigned bucket = 0; bucket < STACK_STATS_BUCKETS; ++bucket) {
+      if (stats->histogram[bucket] == 0)
+        continue;
+      if (bucket == STACK_STATS_BUCKETS - 1)
+        fprintf(out, "    >= %zu: %lu\n", (size_t)STACK_STATS_MIN_BUCKET << (bucket - 1),
+                stats->histogram[bucket]);
+      else
+        fprintf(out, "    < %zu: %lu\n", (size_t)STACK_STATS_MIN_BUCKET << bucket,
+                stats->histogram[bucket]);
+    }
+  }
+}
+
+void l1_stack_stats_reset(void) {
+  stack_stats_num = 0;
+}
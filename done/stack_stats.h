@@ -0,0 +1,53 @@
+/**
+ * @file stack_stats.h
+ * @brief Stack use statistics, based on stack high-watermarks
+ *
+ * With watermarking on (see `l1_stack_set_watermarking`), the high-watermark
+ * of every thread is recorded when it becomes a zombie, and aggregated per
+ * thread entry function. This tells how small the stack of each kind of
+ * thread can safely be.
+ */
+#pragma once
+#include <stdio.h>
+#include "thread_info.h"
+
+/* Maximum number of distinct thread functions recorded */
+#define STACK_STATS_MAX_FUNCS 64
+/* Histogram bucket i counts watermarks below (STACK_STATS_MIN_BUCKET << i)
+ * bytes, the last bucket counts all larger ones */
+#define STACK_STATS_MIN_BUCKET 256
+#define STACK_STATS_BUCKETS 13
+
+/**
+ * @brief Stack use of the finished threads of one thread function
+ */
+typedef struct {
+  thread_func_t func;                             /** Thread entry function */
+  unsigned long threads;                          /** Number of threads recorded */
+  size_t max;                                     /** Largest high-watermark */
+  unsigned long histogram[STACK_STATS_BUCKETS];   /** High-watermark histogram */
+} l1_stack_stats;
+
+/**
+ * @brief Records the high-watermark of a thread under its thread function
+ *
+ * Called when the thread becomes a zombie, before its stack is released.
+ * Threads whose stack was not watermarked are ignored.
+ */
+void l1_stack_stats_record(l1_thread_info* thread);
+
+/**
+ * @brief Returns the statistics of a thread function, NULL if none
+ */
+const l1_stack_stats* l1_stack_stats_find(thread_func_t func);
+
+/**
+ * @brief Prints the high-watermark of every live thread, followed by the
+ * histogram of every recorded thread function
+ */
+void l1_stack_stats_report(FILE* out);
+
+/**
+ * @brief Forgets all recorded statistics
+ */
+void l1_stack_stats_reset(void);
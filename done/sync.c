@@ -0,0 +1,194 @@
+/**
+ * @file sync.c
+ * @brief Implementation of the synchronization objects
+ */
+#include <stdio.h>
+#include "schedule.h"
+#include "sync.h"
+#include "wait_queue.h"
+
+/* The calling thread, tsys outside of green threads, NULL without scheduler */
+static l1_thread_info* sync_current(void) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  return sched_info ? sched_info->current : NULL;
+}
+
+static l1_error sync_error(const char* fn) {
+  l1_errno = ERRINVAL;
+  fprintf(stderr, "%s(): errno %d %s\n", fn, l1_errno, l1_strerror(l1_errno));
+  return l1_errno;
+}
+
+/* Only green threads can leave the CPU to others. M:N workers only requeue
+ * threads which yield, block on a join or finish: a WAITING one would be
+ * lost. */
+static bool sync_can_block(void) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  return sched_info && sched_info->current != sched_info->tsys && !sched_info->worker;
+}
+
+/* Waits in queue until a thread hands over what the caller waits for */
+static void sync_block(l1_wait_queue* queue) {
+  l1_thread_info* current = sync_current();
+
+  current->state = WAITING;
+  wait_queue_add(queue, current);
+  yield(-1);
+}
+
+/* thread got what it waited for */
+static void sync_wake(l1_thread_info* thread, bool switch_to) {
+  wake_thread(thread);
+  if (switch_to && sync_can_block()) {
+    yield(thread->id);
+  }
+}
+
+void l1_mutex_init(l1_mutex* mutex, bool switch_on_wake) {
+  mutex->owner = NULL;
+  mutex->waiters.head = mutex->waiters.tail = NULL;
+  mutex->switch_on_wake = switch_on_wake;
+}
+
+l1_error l1_mutex_lock(l1_mutex* mutex) {
+  l1_thread_info* current = sync_current();
+
+  if (!current || mutex->owner == current) {
+    return sync_error("l1_mutex_lock");
+  }
+  if (!mutex->owner) {
+    mutex->owner = current;
+    return SUCCESS;
+  }
+  if (!sync_can_block()) {
+    return sync_error("l1_mutex_lock");
+  }
+  /* We own the mutex once woken up */
+  sync_block(&mutex->waiters);
+  return SUCCESS;
+}
+
+bool l1_mutex_trylock(l1_mutex* mutex) {
+  l1_thread_info* current = sync_current();
+
+  if (!current || mutex->owner) {
+    return false;
+  }
+  mutex->owner = current;
+  return true;
+}
+
+/* Makes the first waiter the owner, returns it */
+static l1_thread_info* mutex_hand_over(l1_mutex* mutex) {
+  l1_thread_info* next = wait_queue_pop(&mutex->waiters);
+
+  mutex->owner = next;
+  return next;
+}
+
+l1_error l1_mutex_unlock(l1_mutex* mutex) {
+  l1_thread_info* current = sync_current();
+
+  if (!current || mutex->owner != current) {
+    return sync_error("l1_mutex_unlock");
+  }
+  l1_thread_info* next = mutex_hand_over(mutex);
+  if (next) {
+    sync_wake(next, mutex->switch_on_wake);
+  }
+  return SUCCESS;
+}
+
+void l1_cond_init(l1_cond* cond, bool switch_on_wake) {
+  cond->waiters.head = cond->waiters.tail = NULL;
+  cond->switch_on_wake = switch_on_wake;
+}
+
+l1_error l1_cond_wait(l1_cond* cond, l1_mutex* mutex) {
+  l1_thread_info* current = sync_current();
+
+  if (!current || mutex->owner != current || !sync_can_block()) {
+    return sync_error("l1_cond_wait");
+  }
+  current->cond_mutex = mutex;
+  /* No switch to the new owner, we are about to block anyway */
+  l1_thread_info* next = mutex_hand_over(mutex);
+  if (next) {
+    wake_thread(next);
+  }
+  /* We own the mutex again once woken up */
+  sync_block(&cond->waiters);
+  return SUCCESS;
+}
+
+/* Moves the first waiter to its mutex, returns it if it can run */
+static l1_thread_info* cond_wake(l1_cond* cond) {
+  l1_thread_info* thread = wait_queue_pop(&cond->waiters);
+
+  if (!thread) {
+    return NULL;
+  }
+  l1_mutex* mutex = thread->cond_mutex;
+  thread->cond_mutex = NULL;
+  if (mutex->owner) {
+    /* Still WAITING, now for the mutex */
+    wait_queue_add(&mutex->waiters, thread);
+    return NULL;
+  }
+  mutex->owner = thread;
+  wake_thread(thread);
+  return thread;
+}
+
+void l1_cond_signal(l1_cond* cond) {
+  l1_thread_info* thread = cond_wake(cond);
+
+  if (thread && cond->switch_on_wake && sync_can_block()) {
+    yield(thread->id);
+  }
+}
+
+void l1_cond_broadcast(l1_cond* cond) {
+  l1_thread_info* first = NULL;
+
+  while (cond->waiters.head) {
+    l1_thread_info* thread = cond_wake(cond);
+    if (!first) {
+      first = thread;
+    }
+  }
+  if (first && cond->switch_on_wake && sync_can_block()) {
+    yield(first->id);
+  }
+}
+
+void l1_sem_init(l1_sem* sem, unsigned long value, bool switch_on_wake) {
+  sem->value = value;
+  sem->waiters.head = sem->waiters.tail = NULL;
+  sem->switch_on_wake = switch_on_wake;
+}
+
+l1_error l1_sem_wait(l1_sem* sem) {
+  if (sem->value > 0) {
+    sem->value--;
+    return SUCCESS;
+  }
+  if (!sync_can_block()) {
+    return sync_error("l1_sem_wait");
+  }
+  /* The unit is ours once woken up */
+  sync_block(&sem->waiters);
+  return SUCCESS;
+}
+
+void l1_sem_post(l1_sem* sem) {
+  l1_thread_info* thread = wait_queue_pop(&sem->waiters);
+
+  if (thread) {
+    sync_wake(thread, sem->switch_on_wake);
+  } else {
+    sem->value++;
+  }
+}
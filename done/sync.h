@@ -0,0 +1,111 @@
+/**
+ * @file sync.h
+ * @brief Mutexes, condition variables and semaphores for green threads
+ *
+ * A thread which cannot proceed waits in the WAITING state, in a FIFO wait
+ * queue of the object, and leaves the run queue. Releasing the object hands
+ * it directly to the first waiter: unlock makes it the owner of the mutex,
+ * post gives it the unit, and signal moves it to the queue of the mutex
+ * (or makes it the owner if the mutex is free). The woken thread then never
+ * has to compete for the object again.
+ *
+ * If the object was initialized with switch_on_wake, the thread which
+ * wakes up another one also yields to it, as far as the policy allows.
+ *
+ * Blocking needs a green thread: in tsys or before `schedule`, a call
+ * which would block fails with ERRINVAL. So does it in M:N mode, where
+ * workers do not park waiting threads; the objects are not safe across
+ * workers either, so only the calls which do not block are of use there.
+ */
+#pragma once
+#include <stdbool.h>
+#include "error.h"
+#include "thread_info.h"
+
+typedef struct l1_mutex {
+  l1_thread_info* owner;        /** Thread holding the mutex, NULL if free */
+  l1_wait_queue waiters;        /** Threads waiting for the mutex */
+  bool switch_on_wake;          /** Unlock switches to the new owner */
+} l1_mutex;
+
+typedef struct {
+  l1_wait_queue waiters;        /** Threads waiting for a signal */
+  bool switch_on_wake;          /** Signal yields to the woken thread */
+} l1_cond;
+
+typedef struct {
+  unsigned long value;          /** Units available */
+  l1_wait_queue waiters;        /** Threads waiting for a unit */
+  bool switch_on_wake;          /** Post switches to the woken thread */
+} l1_sem;
+
+/**
+ * @brief Initializes a free mutex
+ */
+void l1_mutex_init(l1_mutex* mutex, bool switch_on_wake);
+
+/**
+ * @brief Locks the mutex, waiting for it if another thread holds it
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the thread already holds the mutex or cannot wait.
+ */
+l1_error l1_mutex_lock(l1_mutex* mutex);
+
+/**
+ * @brief Locks the mutex if it is free
+ *
+ * @return  true if the thread now holds the mutex
+ */
+bool l1_mutex_trylock(l1_mutex* mutex);
+
+/**
+ * @brief Unlocks the mutex, handing it to the first waiter if there is one
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the thread does not hold the mutex.
+ */
+l1_error l1_mutex_unlock(l1_mutex* mutex);
+
+/**
+ * @brief Initializes a condition variable without waiters
+ */
+void l1_cond_init(l1_cond* cond, bool switch_on_wake);
+
+/**
+ * @brief Unlocks mutex and waits for a signal, then holds mutex again
+ *
+ * Like pthread_cond_wait, the condition must be checked again in a loop.
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the thread does not hold mutex.
+ */
+l1_error l1_cond_wait(l1_cond* cond, l1_mutex* mutex);
+
+/**
+ * @brief Wakes up the first waiter, if any
+ */
+void l1_cond_signal(l1_cond* cond);
+
+/**
+ * @brief Wakes up all waiters, which then get the mutex in turn
+ */
+void l1_cond_broadcast(l1_cond* cond);
+
+/**
+ * @brief Initializes a semaphore with value units
+ */
+void l1_sem_init(l1_sem* sem, unsigned long value, bool switch_on_wake);
+
+/**
+ * @brief Takes a unit, waiting for one if there is none
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ * ERRINVAL if the thread cannot wait.
+ */
+l1_error l1_sem_wait(l1_sem* sem);
+
+/**
+ * @brief Gives a unit, to the first waiter if there is one
+ */
+void l1_sem_post(l1_sem* sem);
@@ -78,6 +78,54 @@ START_TEST(list_malloc_test_dummy) {
 }
 END_TEST
 
+START_TEST(tiered_malloc_test_dispatch) {
+  /* This will test the size-tiered allocator */
+  l1_init = l1_tiered_init;
+  l1_deinit = l1_tiered_deinit;
+  l1_malloc = l1_tiered_malloc;
+  l1_free = l1_tiered_free;
+
+  size_t K = 1024;
+
+  l1_init();
+  ck_assert_msg(l1_malloc(0) == NULL, "A malloc of size 0 should return NULL.");
+
+  char *small = l1_malloc(32);
+  char *page = l1_malloc(8*K);
+  ck_assert_msg(small >= (char *)l1_slab_heap && 
+                small < (char *)l1_slab_heap + ALLOC8R_HEAP_SIZE,
+                "Small requests should be served by the slab tier.");
+  ck_assert_msg(page >= (char *)l1_chunk_arena && 
+                page < (char *)(l1_chunk_arena + CHUNK_ARENA_LENGTH),
+                "Page-sized requests should be served by the chunk allocator.");
+
+  ck_assert_msg(l1_free(page) == SUCCESS, "Freeing a chunk region should succeed.");
+  ck_assert_msg(l1_free(small) == SUCCESS, "Freeing a slab region should succeed.");
+  ck_assert_msg(l1_free(&K) == ERRINVAL, "Freeing a foreign pointer should fail.");
+  l1_deinit();
+}
+END_TEST
+
+START_TEST(slab_malloc_test_reuse) {
+  /* This will test the slab allocator */
+  l1_init = l1_slab_init;
+  l1_deinit = l1_slab_deinit;
+  l1_malloc = l1_slab_malloc;
+  l1_free = l1_slab_free;
+
+  l1_init();
+  ck_assert_msg(l1_malloc(SLAB_MAX_OBJECT + 1) == NULL, "Oversized requests should fail.");
+
+  char *p1 = l1_malloc(1);
+  char *p2 = l1_malloc(100);
+  ck_assert_msg(l1_free(p1 + 1) == ERRINVAL, "Freeing inside a slot should fail.");
+  ck_assert_msg(l1_free(p1) == SUCCESS, "Freeing a slot should succeed.");
+  ck_assert_msg(l1_malloc(SLAB_MIN_OBJECT) == p1, "A freed slot should be reused first.");
+  ck_assert_msg(l1_free(p2) == SUCCESS, "Freeing a slot should succeed.");
+  l1_deinit();
+}
+END_TEST
+
 int main(int argc, char **argv)
 {
   Suite* s = suite_create("Threading lab");
@@ -90,6 +138,8 @@ int main(int argc, char **argv)
   /* Add more tests of your own */
   tcase_add_test(tc1, list_malloc_test_dummy);
   tcase_add_test(tc1, chunk_malloc_test_seg_fault);
+  tcase_add_test(tc1, slab_malloc_test_reuse);
+  tcase_add_test(tc1, tiered_malloc_test_dispatch);
 
   SRunner *sr = srunner_create(s); 
   srunner_run_all(sr, CK_VERBOSE); 
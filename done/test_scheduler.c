@@ -5,12 +5,1331 @@
  */
 
 #include <check.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "chan.h"
+#include "coro.h"
+#include "deque.h"
+#include "io.h"
+#include "l1_time.h"
+#include "preempt.h"
+#include "schedule.h"
+#include "sched_mn.h"
+#include "sched_policy.h"
+#include "sync.h"
+#include "thread.h"
+#include "thread_heap.h"
+#include "timer_wheel.h"
+#include "trace.h"
+
+#define PING_PONG_ROUNDS 100
+
+static l1_tid players[2];
+static int trace[2 * PING_PONG_ROUNDS];
+static int trace_len;
+
+void* ping_pong_player(void* arg) {
+  int me = (int)(long)arg;
+
+  for (int i = 0; i < PING_PONG_ROUNDS; ++i) {
+    trace[trace_len++] = me;
+    yield(players[1 - me]);
+  }
+  return NULL;
+}
+
+START_TEST(direct_switch_test) {
+  initialize_scheduler(l1_round_robin_policy);
+#ifdef L1_SPLIT_STACK
+  ck_assert_msg(!get_scheduler()->direct_switch,
+                "Direct switches should be off by default with split stacks.");
+  get_scheduler()->direct_switch = true;
+#endif
+  l1_thread_create(&players[0], ping_pong_player, (void*)0L);
+  l1_thread_create(&players[1], ping_pong_player, (void*)1L);
+  trace_len = 0;
+  schedule();
+
+  ck_assert_msg(trace_len == 2 * PING_PONG_ROUNDS, "Both threads should run to completion.");
+  for (int i = 0; i < trace_len; ++i)
+    ck_assert_msg(trace[i] == i % 2, "Directed yields should alternate the threads.");
+  /* One switch per yield, plus going through tsys to start and finish */
+  ck_assert_msg(get_scheduler()->switches < 2 * PING_PONG_ROUNDS + 8,
+                "Yields should switch directly to the target.");
+  clean_up_scheduler();
+}
+END_TEST
+
+static l1_sem park_sems[2];
+
+/* Hands the turn to the other player through a semaphore */
+void* park_player(void* arg) {
+  int me = (int)(long)arg;
+
+  for (int i = 0; i < PING_PONG_ROUNDS; ++i) {
+    if (me == 0) l1_sem_post(&park_sems[1]);
+    l1_sem_wait(&park_sems[me]);
+    if (me == 1) l1_sem_post(&park_sems[0]);
+  }
+  return NULL;
+}
+
+START_TEST(park_switch_test) {
+  initialize_scheduler(l1_round_robin_policy);
+  get_scheduler()->direct_switch = true;
+  l1_sem_init(&park_sems[0], 0, false);
+  l1_sem_init(&park_sems[1], 0, false);
+  l1_thread_create(&players[0], park_player, (void*)0L);
+  l1_thread_create(&players[1], park_player, (void*)1L);
+  schedule();
+  /* One switch per wait, plus going through tsys to start and finish */
+  ck_assert_msg(get_scheduler()->switches < 2 * PING_PONG_ROUNDS + 8,
+                "Threads which start waiting should switch directly to the next one.");
+  clean_up_scheduler();
+
+  initialize_scheduler(l1_round_robin_policy);
+  get_scheduler()->direct_switch = false;
+  l1_thread_create(&players[0], park_player, (void*)0L);
+  l1_thread_create(&players[1], park_player, (void*)1L);
+  schedule();
+  ck_assert(get_scheduler()->switches >= 4 * PING_PONG_ROUNDS);
+  clean_up_scheduler();
+}
+END_TEST
+
+#define GENERATOR_VALUES 10
+
+void* count_generator(void* arg) {
+  long from = (long)arg;
+
+  for (long i = from; i < from + GENERATOR_VALUES; ++i)
+    l1_coro_yield((void*)i);
+  return (void*)-1L;
+}
+
+/* Sums the values of a generator, in a thread or outside of the scheduler */
+void* generator_consumer(void* arg) {
+  l1_coro* gen;
+  long sum = 0;
+  void* value;
+
+  if (l1_coro_create(&gen, count_generator, arg) != SUCCESS)
+    return (void*)-1L;
+  while (l1_coro_resume(gen, &value) == SUCCESS && !l1_coro_done(gen)) {
+    sum += (long)value;
+    /* Interleave with the coroutines of the other consumer */
+    if (get_scheduler())
+      yield(-1);
+  }
+  if ((long)value != -1L)
+    sum = -1;
+  l1_coro_free(gen);
+  return (void*)sum;
+}
+
+START_TEST(coro_generator_test) {
+  void* sum = generator_consumer((void*)0L);
+
+  ck_assert_msg((long)sum == 45, "A generator should yield all its values.");
+}
+END_TEST
+
+void* nested_outer(void* arg) {
+  void* inner_sum = generator_consumer((void*)100L);
+
+  l1_coro_yield(inner_sum);
+  return NULL;
+}
+
+START_TEST(coro_nested_test) {
+  l1_coro* outer;
+  void* value;
+
+  ck_assert(l1_coro_create(&outer, nested_outer, NULL) == SUCCESS);
+  ck_assert(l1_coro_resume(outer, &value) == SUCCESS);
+  ck_assert_msg((long)value == 1045, "A coroutine should be able to resume another one.");
+  ck_assert(!l1_coro_done(outer));
+  ck_assert(l1_coro_resume(outer, &value) == SUCCESS);
+  ck_assert(l1_coro_done(outer));
+  ck_assert_msg(l1_coro_resume(outer, &value) == ERRINVAL,
+                "A finished coroutine should not be resumed.");
+  ck_assert_msg(l1_coro_yield(NULL) == ERRINVAL, "Yielding outside of a coroutine is an error.");
+  l1_coro_free(outer);
+}
+END_TEST
+
+static l1_tid consumers[2];
+static void* consumer_sums[2];
+
+void* join_consumers(void* arg) {
+  for (int i = 0; i < 2; ++i)
+    l1_thread_join(consumers[i], &consumer_sums[i]);
+  return NULL;
+}
+
+START_TEST(coro_threads_test) {
+  l1_tid joiner;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&consumers[0], generator_consumer, (void*)0L);
+  l1_thread_create(&consumers[1], generator_consumer, (void*)10L);
+  l1_thread_create(&joiner, join_consumers, NULL);
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg((long)consumer_sums[0] == 45 && (long)consumer_sums[1] == 145,
+                "Each thread should resume its own coroutine.");
+}
+END_TEST
+
+START_TEST(mlfq_run_queue_test) {
+  l1_run_queue rq = { 0 };
+  l1_thread_info threads[3] = { 0 };
+
+  /* One thread waiting at each of the two lowest levels, one which ran */
+  threads[0].priority_level = LOWEST_PRIORITY;
+  threads[1].priority_level = LOWEST_PRIORITY + 1;
+  threads[2].priority_level = LOWEST_PRIORITY + 1;
+  threads[2].got_scheduled = 1;
+  for (int i = 0; i < 3; ++i)
+    run_queue_add(&rq, &threads[i]);
+
+  ck_assert_msg(run_queue_highest(&rq) == &threads[1],
+                "Threads which did not run go first at the same level.");
+  for (int i = 0; i < NUM_PRIORITIES; ++i)
+    run_queue_boost(&rq);
+  ck_assert_msg(run_queue_level(&rq, &threads[0]) == TOP_PRIORITY &&
+                run_queue_level(&rq, &threads[1]) == TOP_PRIORITY,
+                "Boosts should bring waiting threads up to the top.");
+  ck_assert_msg(run_queue_level(&rq, &threads[2]) == LOWEST_PRIORITY + 1,
+                "Boosts should not change threads which ran.");
+  /* Both reached the top, the one already there first */
+  ck_assert(run_queue_highest(&rq) == &threads[1]);
+  run_queue_remove(&rq, &threads[1]);
+  ck_assert_msg(threads[1].priority_level == TOP_PRIORITY,
+                "A thread leaving the queue should get its boosted level.");
+  ck_assert(run_queue_highest(&rq) == &threads[0]);
+  run_queue_remove(&rq, &threads[0]);
+  ck_assert(run_queue_highest(&rq) == &threads[2]);
+  run_queue_remove(&rq, &threads[2]);
+  ck_assert(run_queue_highest(&rq) == NULL && rq.size == 0);
+}
+END_TEST
+
+#define HEAP_THREADS 40
+/* Keys repeat, so ties come up at every depth */
+#define HEAP_KEY(i) ((uint64_t)((i) * 7 % 10))
+
+/* Every thread knows its slot, and no child is smaller than its parent */
+static bool heap_consistent(l1_thread_heap* heap) {
+  for (size_t k = 0; k < heap->size; ++k) {
+    if (heap->threads[k]->heap_index != k) return false;
+    if (k > 0 && heap->threads[k]->heap_key <
+                 heap->threads[(k - 1) / THREAD_HEAP_ARITY]->heap_key) return false;
+  }
+  return true;
+}
+
+START_TEST(thread_heap_test) {
+  l1_thread_heap heap = { 0 };
+  l1_thread_info threads[HEAP_THREADS] = { 0 };
+
+  ck_assert(thread_heap_min(&heap) == NULL);
+  for (int i = 0; i < HEAP_THREADS; ++i) {
+    threads[i].id = i;
+    threads[i].heap_key = HEAP_KEY(i);
+    ck_assert(thread_heap_push(&heap, &threads[i]) == SUCCESS);
+    ck_assert_msg(heap_consistent(&heap), "Pushes should keep the heap ordered.");
+  }
+  ck_assert_msg(thread_heap_min(&heap) == &threads[0], "The first of the smallest keys should be the min.");
+
+  /* From the middle, then from the last slot */
+  l1_thread_info* middle = heap.threads[heap.size / 2];
+  thread_heap_remove(&heap, middle);
+  ck_assert(middle->heap_index == THREAD_HEAP_NONE && heap.size == HEAP_THREADS - 1);
+  ck_assert_msg(heap_consistent(&heap), "Removing from the middle should keep the heap ordered.");
+  l1_thread_info* last = heap.threads[heap.size - 1];
+  thread_heap_remove(&heap, last);
+  ck_assert(last->heap_index == THREAD_HEAP_NONE && heap.size == HEAP_THREADS - 2);
+  ck_assert_msg(heap_consistent(&heap), "Removing the last slot should keep the heap ordered.");
+  /* Not in the heap anymore */
+  thread_heap_remove(&heap, middle);
+  ck_assert(heap.size == HEAP_THREADS - 2);
+
+  /* Equal keys come out in insertion order */
+  l1_thread_info* prev = NULL;
+  for (l1_thread_info* min; (min = thread_heap_min(&heap)) != NULL; prev = min) {
+    if (prev) {
+      ck_assert_msg(prev->heap_key < min->heap_key ||
+                    (prev->heap_key == min->heap_key && prev->id < min->id),
+                    "Threads should come out by key, then first in first out.");
+    }
+    thread_heap_remove(&heap, min);
+    ck_assert(heap_consistent(&heap));
+  }
+  thread_heap_free(&heap);
+}
+END_TEST
+
+static l1_tid cycles_order[3];
+static int cycles_ran;
+
+void* cycles_runner(void* arg) {
+  cycles_order[cycles_ran++] = get_scheduler()->current->id;
+  return NULL;
+}
+
+START_TEST(smallest_cycles_test) {
+  l1_time cycles[3] = { 30 * L1_TIME_MS, 10 * L1_TIME_MS, 20 * L1_TIME_MS };
+  l1_tid tids[3];
+
+  initialize_scheduler(l1_smallest_cycles_policy);
+  /* As if they had run for cycles already */
+  for (int i = 0; i < 3; ++i) {
+    l1_thread_create(&tids[i], cycles_runner, NULL);
+    l1_thread_info* thread = get_thread(tids[i]);
+    get_scheduler()->queue.dequeue(thread);
+    thread->total_time = cycles[i];
+    get_scheduler()->queue.enqueue(thread);
+  }
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(cycles_ran == 3 && cycles_order[0] == tids[1] &&
+                cycles_order[1] == tids[2] && cycles_order[2] == tids[0],
+                "The thread which ran the least should run first.");
+}
+END_TEST
+
+#define MN_WORKERS 4
+
+/* Computes fib(n) with a thread per call, joined by its parent */
+void* fork_join_fib(void* arg) {
+  long n = (long)arg;
+  l1_tid children[2];
+  void* results[2];
+
+  if (n < 2)
+    return arg;
+  for (int i = 0; i < 2; ++i) {
+    if (l1_thread_create(&children[i], fork_join_fib, (void*)(n - 1 - i)) != SUCCESS)
+      return (void*)-1L;
+    /* Give the other workers a chance to steal */
+    yield(-1);
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (l1_thread_join(children[i], &results[i]) != SUCCESS)
+      return (void*)-1L;
+  }
+  return (void*)((long)results[0] + (long)results[1]);
+}
+
+void* fork_join_root(void* arg) {
+  l1_tid fib;
+
+  if (l1_thread_create(&fib, fork_join_fib, (void*)15L) != SUCCESS ||
+      l1_thread_join(fib, arg) != SUCCESS)
+    *(void**)arg = NULL;
+  return NULL;
+}
+
+START_TEST(mn_fork_join_test) {
+  void* result = NULL;
+  l1_tid root;
+
+  ck_assert(l1_mn_init(MN_WORKERS) == SUCCESS);
+  l1_thread_create(&root, fork_join_root, &result);
+  l1_mn_schedule();
+  l1_mn_clean_up();
+
+  ck_assert_msg((long)result == 610, "Threads should join across workers.");
+}
+END_TEST
+
+#define DEQUE_ITEMS (4 * DEQUE_INITIAL_SIZE)
+#define DEQUE_RACE_ROUNDS 100000
+
+/* The deque never dereferences its threads */
+#define DEQUE_ITEM(i) ((l1_thread_info*)(uintptr_t)((i) + 1))
+#define DEQUE_INDEX(thread) ((long)(uintptr_t)(thread) - 1)
+
+static l1_deque race_deque;
+static atomic_int race_claims[DEQUE_RACE_ROUNDS];
+static atomic_bool race_done;
+
+/* Steals from race_deque until the owner is done */
+void* deque_thief(void* arg) {
+  while (!atomic_load(&race_done)) {
+    l1_thread_info* thread = deque_steal(&race_deque);
+
+    if (thread) atomic_fetch_add(&race_claims[DEQUE_INDEX(thread)], 1);
+  }
+  return NULL;
+}
+
+START_TEST(deque_test) {
+  l1_deque deque;
+
+  /* The owner takes the newest threads, thieves the oldest, across growth */
+  ck_assert(deque_init(&deque) == SUCCESS);
+  for (long i = 0; i < DEQUE_ITEMS; ++i)
+    ck_assert(deque_push(&deque, DEQUE_ITEM(i)) == SUCCESS);
+  for (long i = 0; i < DEQUE_ITEMS / 4; ++i)
+    ck_assert_msg(deque_steal(&deque) == DEQUE_ITEM(i), "Thieves should steal the oldest threads.");
+  for (long i = DEQUE_ITEMS - 1; i >= DEQUE_ITEMS / 4; --i)
+    ck_assert_msg(deque_take(&deque) == DEQUE_ITEM(i), "The owner should take the newest threads.");
+  ck_assert(deque_take(&deque) == NULL && deque_steal(&deque) == NULL);
+
+  /* The last thread goes to exactly one of the owner and a thief */
+  ck_assert(deque_push(&deque, DEQUE_ITEM(0)) == SUCCESS);
+  ck_assert(deque_steal(&deque) == DEQUE_ITEM(0) && deque_take(&deque) == NULL);
+  ck_assert(deque_push(&deque, DEQUE_ITEM(1)) == SUCCESS);
+  ck_assert(deque_take(&deque) == DEQUE_ITEM(1) && deque_steal(&deque) == NULL);
+  deque_free(&deque);
+
+  /* Same race with a thief on another OS thread */
+  pthread_t thief;
+
+  ck_assert(deque_init(&race_deque) == SUCCESS);
+  atomic_store(&race_done, false);
+  pthread_create(&thief, NULL, deque_thief, NULL);
+  for (long i = 0; i < DEQUE_RACE_ROUNDS; ++i) {
+    ck_assert(deque_push(&race_deque, DEQUE_ITEM(i)) == SUCCESS);
+    l1_thread_info* thread = deque_take(&race_deque);
+
+    if (thread) atomic_fetch_add(&race_claims[DEQUE_INDEX(thread)], 1);
+  }
+  atomic_store(&race_done, true);
+  pthread_join(thief, NULL);
+  ck_assert(deque_steal(&race_deque) == NULL);
+  deque_free(&race_deque);
+  for (long i = 0; i < DEQUE_RACE_ROUNDS; ++i)
+    ck_assert_msg(atomic_load(&race_claims[i]) == 1,
+                  "Each thread should be taken or stolen exactly once.");
+}
+END_TEST
+
+static volatile bool steal_child_ran;
+
+void* steal_child(void* arg) {
+  steal_child_ran = true;
+  return NULL;
+}
+
+/* Keeps its worker busy, so that only another worker can run the child */
+void* steal_root(void* arg) {
+  l1_tid child;
+  uint64_t deadline = l1_time_now_ns() + 5 * L1_TIME_S;
+
+  if (l1_thread_create(&child, steal_child, NULL) != SUCCESS)
+    return NULL;
+  while (!steal_child_ran && l1_time_now_ns() < deadline);
+  l1_thread_join(child, NULL);
+  return NULL;
+}
+
+START_TEST(mn_steal_test) {
+  l1_tid root;
+  uint64_t steals = 0;
+
+  ck_assert(l1_mn_init(MN_WORKERS) == SUCCESS);
+  l1_thread_create(&root, steal_root, NULL);
+  l1_mn_schedule();
+  for (unsigned i = 0; i < MN_WORKERS; ++i)
+    steals += l1_mn_worker(i)->steals;
+  l1_mn_clean_up();
+
+  ck_assert_msg(steal_child_ran && steals > 0,
+                "An idle worker should steal the thread of a busy one.");
+}
+END_TEST
+
+static int io_fds[2];
+static int io_progress;
+static bool io_read_ok, io_write_ok;
+
+void* io_reader(void* arg) {
+  char buf[8] = { 0 };
+
+  /* Nothing was written yet, then nothing more */
+  io_read_ok = l1_read(io_fds[0], buf, sizeof(buf)) == 5 && io_progress == 3 &&
+               strcmp(buf, "hello") == 0 &&
+               l1_wait_fd(io_fds[0], EPOLLIN, 10) == ERRTIMEDOUT;
+  return NULL;
+}
+
+void* io_writer(void* arg) {
+  /* The reader waits while this thread runs */
+  for (io_progress = 0; io_progress < 3; ++io_progress)
+    yield(-1);
+  io_write_ok = l1_write(io_fds[1], "hello", 5) == 5;
+  return NULL;
+}
+
+START_TEST(io_wait_test) {
+  l1_tid reader, writer;
+
+  ck_assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, io_fds) == 0);
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&reader, io_reader, NULL);
+  l1_thread_create(&writer, io_writer, NULL);
+  schedule();
+  clean_up_scheduler();
+  close(io_fds[0]);
+  close(io_fds[1]);
+
+  ck_assert_msg(io_write_ok, "The writer should write.");
+  ck_assert_msg(io_read_ok, "The reader should wait for the data, then time out.");
+}
+END_TEST
+
+#define WHEEL_THREADS 1000
+
+static l1_thread_info wheel_threads[WHEEL_THREADS];
+static uint64_t wheel_now;
+static int wheel_expired;
+static bool wheel_early, wheel_late;
+
+static void wheel_expire(l1_thread_info* thread) {
+  uint64_t deadline = thread->heap_key;
+
+  wheel_expired++;
+  wheel_early |= wheel_now < deadline;
+  /* At most one tick late, plus the step of the test */
+  wheel_late |= wheel_now > deadline + (2ULL << TIMER_WHEEL_TICK_SHIFT) + 1000000;
+}
+
+START_TEST(timer_wheel_test) {
+  l1_timer_wheel wheel;
+  uint64_t start = 123456789;
+
+  /* Deadlines from now to hours away, over several levels */
+  srand(42);
+  timer_wheel_init(&wheel, start);
+  for (int i = 0; i < WHEEL_THREADS; ++i) {
+    uint64_t delay = (uint64_t)rand() << (rand() % 12);
+    wheel_threads[i].heap_key = start + delay;
+    timer_wheel_add(&wheel, &wheel_threads[i], start + delay);
+  }
+  /* Removed threads never expire */
+  for (int i = 0; i < WHEEL_THREADS; i += 10)
+    timer_wheel_remove(&wheel, &wheel_threads[i]);
+
+  /* Jump to the next deadline, or by 1 ms */
+  for (wheel_now = start; wheel.count > 0;) {
+    uint64_t next = timer_wheel_next(&wheel);
+    ck_assert(next != TIMER_WHEEL_NONE);
+    wheel_now = next > wheel_now + 1000000 ? next : wheel_now + 1000000;
+    timer_wheel_advance(&wheel, wheel_now, wheel_expire);
+  }
+  ck_assert_msg(timer_wheel_next(&wheel) == TIMER_WHEEL_NONE, "The wheel should be empty.");
+  ck_assert_msg(wheel_expired == WHEEL_THREADS - WHEEL_THREADS / 10, "All threads should expire once.");
+  ck_assert_msg(!wheel_early, "No thread should expire before its deadline.");
+  ck_assert_msg(!wheel_late, "No thread should expire long after its deadline.");
+}
+END_TEST
+
+#define SLEEPERS 5
+
+static int sleep_order[SLEEPERS];
+static int sleep_woken;
+static bool sleep_early;
+static void* sleep_joined;
+
+void* sleeper(void* arg) {
+  long i = (long)arg;
+  uint64_t deadline = l1_time_now_ns() + (SLEEPERS - i) * 2000000ULL;
+
+  l1_sleep_until(deadline);
+  sleep_early |= l1_time_now_ns() < deadline;
+  sleep_order[sleep_woken++] = i;
+  return NULL;
+}
+
+void* timed_joiner(void* arg) {
+  l1_tid target = *(l1_tid*)arg;
+  void* retval = NULL;
+
+  /* Gives up once, then gets the value */
+  if (l1_thread_join_timeout(target, &retval, 1000000) == ERRTIMEDOUT &&
+      l1_thread_join_timeout(target, &retval, 100000000) == SUCCESS)
+    sleep_joined = retval;
+  return NULL;
+}
+
+void* slow_thread(void* arg) {
+  l1_sleep_ns(5000000);
+  return (void*)42L;
+}
+
+START_TEST(sleep_test) {
+  l1_tid tid, slow;
+
+  initialize_scheduler(l1_round_robin_policy);
+  for (long i = 0; i < SLEEPERS; ++i)
+    l1_thread_create(&tid, sleeper, (void*)i);
+  l1_thread_create(&slow, slow_thread, NULL);
+  l1_thread_create(&tid, timed_joiner, &slow);
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(!sleep_early, "Threads should not wake up before their deadline.");
+  for (int i = 0; i < SLEEPERS; ++i)
+    ck_assert_msg(sleep_order[i] == SLEEPERS - 1 - i, "Threads should wake up by deadline.");
+  ck_assert_msg(sleep_joined == (void*)42L, "A join should time out, then succeed.");
+}
+END_TEST
+
+#define SYNC_THREADS 4
+#define SYNC_ROUNDS 100
+#define BUFFER_SIZE 2
+
+static l1_mutex sync_mutex;
+static l1_cond not_full, not_empty;
+static l1_sem sync_sems[2];
+static int sync_counter, sync_inside;
+static bool sync_overlap;
+static int buffer[BUFFER_SIZE], buffer_len;
+static long consumed_sum;
+static int sem_trace[2 * SYNC_ROUNDS], sem_trace_len;
+
+void* mutex_incrementer(void* arg) {
+  for (int i = 0; i < SYNC_ROUNDS; ++i) {
+    l1_mutex_lock(&sync_mutex);
+    sync_overlap |= sync_inside++ > 0;
+    int value = sync_counter;
+    /* Other threads run, and wait for the mutex */
+    yield(-1);
+    sync_counter = value + 1;
+    sync_inside--;
+    l1_mutex_unlock(&sync_mutex);
+  }
+  return NULL;
+}
+
+void* buffer_producer(void* arg) {
+  for (int i = 1; i <= SYNC_ROUNDS; ++i) {
+    l1_mutex_lock(&sync_mutex);
+    while (buffer_len == BUFFER_SIZE)
+      l1_cond_wait(&not_full, &sync_mutex);
+    buffer[buffer_len++] = i;
+    l1_cond_signal(&not_empty);
+    l1_mutex_unlock(&sync_mutex);
+  }
+  return NULL;
+}
+
+void* buffer_consumer(void* arg) {
+  for (int i = 0; i < SYNC_ROUNDS; ++i) {
+    l1_mutex_lock(&sync_mutex);
+    while (buffer_len == 0)
+      l1_cond_wait(&not_empty, &sync_mutex);
+    consumed_sum += buffer[--buffer_len];
+    l1_cond_signal(&not_full);
+    l1_mutex_unlock(&sync_mutex);
+  }
+  return NULL;
+}
+
+void* sem_player(void* arg) {
+  int me = (int)(long)arg;
+
+  for (int i = 0; i < SYNC_ROUNDS; ++i) {
+    l1_sem_wait(&sync_sems[me]);
+    sem_trace[sem_trace_len++] = me;
+    l1_sem_post(&sync_sems[1 - me]);
+  }
+  return NULL;
+}
+
+START_TEST(mutex_test) {
+  l1_tid tid;
+
+  for (int handoff = 0; handoff < 2; ++handoff) {
+    sync_counter = 0;
+    initialize_scheduler(l1_round_robin_policy);
+    l1_mutex_init(&sync_mutex, handoff);
+    for (int i = 0; i < SYNC_THREADS; ++i)
+      l1_thread_create(&tid, mutex_incrementer, NULL);
+    schedule();
+    clean_up_scheduler();
+
+    ck_assert_msg(!sync_overlap, "One thread at a time should hold the mutex.");
+    ck_assert_msg(sync_counter == SYNC_THREADS * SYNC_ROUNDS, "No increment should be lost.");
+  }
+}
+END_TEST
+
+START_TEST(cond_sem_test) {
+  l1_tid tid;
+
+  for (int handoff = 0; handoff < 2; ++handoff) {
+    consumed_sum = 0;
+    sem_trace_len = 0;
+    initialize_scheduler(l1_round_robin_policy);
+    l1_mutex_init(&sync_mutex, handoff);
+    l1_cond_init(&not_full, handoff);
+    l1_cond_init(&not_empty, handoff);
+    l1_sem_init(&sync_sems[0], 1, handoff);
+    l1_sem_init(&sync_sems[1], 0, handoff);
+    for (int i = 0; i < SYNC_THREADS / 2; ++i) {
+      l1_thread_create(&tid, buffer_consumer, NULL);
+      l1_thread_create(&tid, buffer_producer, NULL);
+    }
+    l1_thread_create(&tid, sem_player, (void*)1L);
+    l1_thread_create(&tid, sem_player, (void*)0L);
+    schedule();
+    clean_up_scheduler();
+
+    ck_assert_msg(consumed_sum == SYNC_THREADS / 2 * SYNC_ROUNDS * (SYNC_ROUNDS + 1) / 2,
+                  "Consumers should get every item.");
+    ck_assert_msg(sem_trace_len == 2 * SYNC_ROUNDS, "Both players should finish.");
+    for (int i = 0; i < sem_trace_len; ++i)
+      ck_assert_msg(sem_trace[i] == i % 2, "Players should alternate.");
+  }
+}
+END_TEST
+
+static l1_mutex mn_mutex;
+static l1_sem mn_sem;
+static l1_error mn_lock_err, mn_sem_err;
+static bool mn_holder_done;
+
+void* mn_contender(void* arg) {
+  mn_lock_err = l1_mutex_lock(&mn_mutex);
+  mn_sem_err = l1_sem_wait(&mn_sem);
+  return NULL;
+}
+
+/* Holds mn_mutex while mn_contender runs */
+void* mn_holder(void* arg) {
+  l1_tid contender;
+
+  l1_mutex_lock(&mn_mutex);
+  l1_thread_create(&contender, mn_contender, NULL);
+  l1_thread_join(contender, NULL);
+  l1_mutex_unlock(&mn_mutex);
+  mn_holder_done = true;
+  return NULL;
+}
+
+/* Blocking would lose the thread on a worker: it fails instead of hanging */
+START_TEST(mn_sync_test) {
+  l1_tid root;
+
+  l1_mutex_init(&mn_mutex, false);
+  l1_sem_init(&mn_sem, 0, false);
+  ck_assert(l1_mn_init(1) == SUCCESS);
+  l1_thread_create(&root, mn_holder, NULL);
+  l1_mn_schedule();
+  l1_mn_clean_up();
+
+  ck_assert_msg(mn_holder_done, "The holder should finish.");
+  ck_assert_msg(mn_lock_err == ERRINVAL && mn_sem_err == ERRINVAL,
+                "Blocking on a mutex or a semaphore should fail in M:N mode.");
+}
+END_TEST
+
+#define CHAN_ITEMS 100
+
+static l1_chan* chans[3];
+static long chan_sum;
+static int select_counts[2];
+static bool select_nonblock_ok;
+
+void* chan_producer(void* arg) {
+  l1_chan* out = arg;
+
+  for (long i = 1; i <= CHAN_ITEMS; ++i)
+    l1_chan_send(out, &i);
+  l1_chan_close(out);
+  return NULL;
+}
+
+/* Doubles the items of chans[0] into chans[1] */
+void* chan_doubler(void* arg) {
+  long item;
+  bool ok;
+
+  while (l1_chan_recv(chans[0], &item, &ok) == SUCCESS && ok) {
+    item *= 2;
+    l1_chan_send(chans[1], &item);
+  }
+  l1_chan_close(chans[1]);
+  return NULL;
+}
+
+void* chan_consumer(void* arg) {
+  long item;
+  bool ok;
+
+  while (l1_chan_recv(chans[1], &item, &ok) == SUCCESS && ok)
+    chan_sum += item;
+  return NULL;
+}
+
+/* Receives from chans[0] and chans[1] until both are closed */
+void* chan_selector(void* arg) {
+  long items[2];
+  l1_chan_case cases[2] = {
+    { chans[0], L1_CHAN_RECV, &items[0] },
+    { chans[1], L1_CHAN_RECV, &items[1] },
+  };
+  int open = 2;
+
+  select_nonblock_ok = l1_chan_select(cases, 2, true) == -1;
+  while (open > 0) {
+    int i = l1_chan_select(cases, 2, false);
+
+    if (cases[i].ok) {
+      chan_sum += items[i];
+      select_counts[i]++;
+    } else {
+      /* Never chosen again */
+      cases[i].chan = chans[2];
+      open--;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(chan_test) {
+  l1_tid tid;
+
+  /* Unbuffered, then buffered */
+  for (size_t capacity = 0; capacity <= 4; capacity += 4) {
+    chan_sum = 0;
+    initialize_scheduler(l1_round_robin_policy);
+    l1_chan_create(&chans[0], sizeof(long), capacity);
+    l1_chan_create(&chans[1], sizeof(long), capacity);
+    l1_thread_create(&tid, chan_consumer, NULL);
+    l1_thread_create(&tid, chan_doubler, NULL);
+    l1_thread_create(&tid, chan_producer, chans[0]);
+    schedule();
+    clean_up_scheduler();
+    l1_chan_free(chans[0]);
+    l1_chan_free(chans[1]);
+
+    ck_assert_msg(chan_sum == CHAN_ITEMS * (CHAN_ITEMS + 1), "Every item should go through.");
+  }
+}
+END_TEST
+
+START_TEST(chan_select_test) {
+  l1_tid tid;
+
+  chan_sum = 0;
+  initialize_scheduler(l1_round_robin_policy);
+  l1_chan_create(&chans[0], sizeof(long), 0);
+  l1_chan_create(&chans[1], sizeof(long), 2);
+  /* Never ready */
+  l1_chan_create(&chans[2], sizeof(long), 0);
+  l1_thread_create(&tid, chan_selector, NULL);
+  l1_thread_create(&tid, chan_producer, chans[0]);
+  l1_thread_create(&tid, chan_producer, chans[1]);
+  schedule();
+  clean_up_scheduler();
+  for (int i = 0; i < 3; ++i)
+    l1_chan_free(chans[i]);
+
+  ck_assert_msg(select_nonblock_ok, "A non-blocking select should not wait.");
+  ck_assert_msg(select_counts[0] == CHAN_ITEMS && select_counts[1] == CHAN_ITEMS,
+                "Select should receive from both channels.");
+  ck_assert_msg(chan_sum == CHAN_ITEMS * (CHAN_ITEMS + 1), "Every item should go through.");
+}
+END_TEST
+
+#ifndef L1_SPLIT_STACK
+/* Waits on the shared stack, with locals the other shared-stack threads
+ * overwrite while they are resident */
+START_TEST(chan_shared_stack_test) {
+  l1_tid tid;
+
+  /* Unbuffered, then buffered */
+  for (size_t capacity = 0; capacity <= 4; capacity += 4) {
+    chan_sum = 0;
+    initialize_scheduler(l1_round_robin_policy);
+    l1_chan_create(&chans[0], sizeof(long), capacity);
+    l1_chan_create(&chans[1], sizeof(long), capacity);
+    l1_thread_create_shared(&tid, chan_consumer, NULL);
+    l1_thread_create_shared(&tid, chan_doubler, NULL);
+    l1_thread_create_shared(&tid, chan_producer, chans[0]);
+    schedule();
+    clean_up_scheduler();
+    l1_chan_free(chans[0]);
+    l1_chan_free(chans[1]);
+
+    ck_assert_msg(chan_sum == CHAN_ITEMS * (CHAN_ITEMS + 1),
+                  "Every item should go through shared-stack threads.");
+  }
+
+  chan_sum = 0;
+  select_counts[0] = select_counts[1] = 0;
+  initialize_scheduler(l1_round_robin_policy);
+  l1_chan_create(&chans[0], sizeof(long), 0);
+  l1_chan_create(&chans[1], sizeof(long), 0);
+  l1_chan_create(&chans[2], sizeof(long), 0);
+  l1_thread_create_shared(&tid, chan_selector, NULL);
+  l1_thread_create_shared(&tid, chan_producer, chans[0]);
+  l1_thread_create(&tid, chan_producer, chans[1]);
+  schedule();
+  clean_up_scheduler();
+  for (int i = 0; i < 3; ++i)
+    l1_chan_free(chans[i]);
+
+  ck_assert_msg(select_counts[0] == CHAN_ITEMS && select_counts[1] == CHAN_ITEMS,
+                "A shared-stack select should receive from both channels.");
+  ck_assert_msg(chan_sum == CHAN_ITEMS * (CHAN_ITEMS + 1), "Every item should go through.");
+}
+END_TEST
+#endif
+
+static l1_error mn_send_err, mn_recv_err;
+
+void* mn_chan_user(void* arg) {
+  long item = 1;
+
+  mn_send_err = l1_chan_send(chans[0], &item);
+  mn_recv_err = l1_chan_recv(chans[0], &item, NULL);
+  return NULL;
+}
+
+/* Waiting would lose the thread on a worker: it fails instead of hanging */
+START_TEST(mn_chan_test) {
+  l1_tid tid;
+
+  l1_chan_create(&chans[0], sizeof(long), 0);
+  ck_assert(l1_mn_init(1) == SUCCESS);
+  l1_thread_create(&tid, mn_chan_user, NULL);
+  l1_mn_schedule();
+  l1_mn_clean_up();
+  l1_chan_free(chans[0]);
+
+  ck_assert_msg(mn_send_err == ERRINVAL && mn_recv_err == ERRINVAL,
+                "Waiting on a channel should fail in M:N mode.");
+}
+END_TEST
+
+static volatile int spin_stop;
+static volatile int other_ran;
+static int critical_kept;
+
+/* Never yields on its own */
+void* spinner(void* arg) {
+  while (!spin_stop);
+  return NULL;
+}
+
+void* spin_stopper(void* arg) {
+  spin_stop = 1;
+  return NULL;
+}
+
+/* Spins for 20 ticks in a critical section, then lets other_runner run */
+void* critical_spinner(void* arg) {
+  l1_critical_enter();
+  uint64_t end = l1_time_now_ns() + 20000000;
+  while (l1_time_now_ns() < end);
+  critical_kept = !other_ran;
+  l1_critical_exit();
+  return NULL;
+}
+
+void* other_runner(void* arg) {
+  other_ran = 1;
+  return NULL;
+}
+
+START_TEST(preempt_test) {
+  initialize_scheduler(l1_round_robin_policy);
+#ifdef L1_SPLIT_STACK
+  ck_assert_msg(l1_preempt_start(L1_PREEMPT_VIRTUAL, 1000000) == ERRINVAL,
+                "Preemption is not available with split stacks.");
+  clean_up_scheduler();
+#else
+  l1_tid tid;
+
+  l1_thread_create(&tid, spinner, NULL);
+  l1_thread_create(&tid, spin_stopper, NULL);
+  l1_thread_create(&tid, critical_spinner, NULL);
+  l1_thread_create(&tid, other_runner, NULL);
+  ck_assert_msg(l1_preempt_start(L1_PREEMPT_VIRTUAL, 1000000) == SUCCESS,
+                "Preemption should start.");
+  /* Hangs in spinner unless it is preempted */
+  schedule();
+  l1_preempt_stop();
+  clean_up_scheduler();
+
+  ck_assert_msg(critical_kept, "A critical section should not be preempted.");
+  ck_assert_msg(other_ran, "The thread should yield after its critical section.");
+#endif
+}
+END_TEST
+
+static void* pending_join_rv;
+
+void* join_retval_child(void* arg) {
+  return (void*)0x1234;
+}
+
+/* Joins a zombie with a preemption pending, as left by a tick in a critical
+ * section */
+void* pending_joiner(void* arg) {
+  l1_tid child;
+
+  l1_thread_create(&child, join_retval_child, NULL);
+  yield(-1);
+  l1_preempt_pending = 1;
+  l1_thread_join(child, &pending_join_rv);
+  return NULL;
+}
+
+START_TEST(preempt_join_test) {
+  l1_tid tid;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&tid, pending_joiner, NULL);
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(pending_join_rv == (void*)0x1234,
+                "A pending preemption should not lose the return value of a join.");
+}
+END_TEST
+
+#define SHARE_THREADS 3
+#define SHARE_WINDOW (300 * L1_TIME_MS)
+#define SHARE_QUANTUM (20 * L1_TIME_US)
+
+static l1_time share_end;
+static l1_time share_busy[SHARE_THREADS];
+
+/* Runs for a quantum each time it is scheduled, until share_end */
+void* share_worker(void* arg) {
+  long me = (long)arg;
+  l1_time start, now;
+
+  for (l1_time_get(&start); start < share_end; l1_time_get(&start)) {
+    do {
+      l1_time_get(&now);
+    } while (now - start < SHARE_QUANTUM);
+    share_busy[me] += now - start;
+    yield(-1);
+  }
+  return NULL;
+}
+
+/* Tickets 1:2:3 */
+static void share_tickets(l1_tid tid, int i) {
+  l1_thread_set_tickets(tid, 100 * (i + 1));
+}
+
+static const double ticket_shares[SHARE_THREADS] = { 1 / 6.0, 2 / 6.0, 3 / 6.0 };
+
+/* Largest relative error of the CPU shares of threads set up by configure */
+static double share_error(sched_policy policy, void (*configure)(l1_tid, int),
+                          const double* expected) {
+  l1_tid tids[SHARE_THREADS];
+  l1_time total = 0;
+  double error = 0;
+
+  initialize_scheduler(policy);
+  for (long i = 0; i < SHARE_THREADS; ++i) {
+    share_busy[i] = 0;
+    l1_thread_create(&tids[i], share_worker, (void*)i);
+    configure(tids[i], i);
+  }
+  l1_time_get(&share_end);
+  share_end += SHARE_WINDOW;
+  schedule();
+  clean_up_scheduler();
+
+  for (int i = 0; i < SHARE_THREADS; ++i)
+    total += share_busy[i];
+  for (int i = 0; i < SHARE_THREADS; ++i) {
+    double share = (double)share_busy[i] / total;
+    double e = share > expected[i] ? share / expected[i] - 1 : 1 - share / expected[i];
+
+    if (e > error) error = e;
+  }
+  return error;
+}
+
+START_TEST(stride_share_test) {
+  l1_tid tid;
+
+  ck_assert_msg(share_error(l1_stride_policy, share_tickets, ticket_shares) < 0.05,
+                "Stride shares should be within 5%% of the tickets.");
+  ck_assert_msg(share_error(l1_lottery_policy, share_tickets, ticket_shares) < 0.10,
+                "Lottery shares should be within 10%% of the tickets.");
+
+  initialize_scheduler(l1_stride_policy);
+  l1_thread_create(&tid, share_worker, NULL);
+  ck_assert(l1_thread_set_tickets(tid, 0) == ERRINVAL);
+  ck_assert(l1_thread_set_tickets(tid + 1, 1) == ERRINVAL);
+  schedule();
+  clean_up_scheduler();
+}
+END_TEST
+
+#define EDF_JOBS 20
+
+static int edf_order[3];
+static int edf_ran;
+static volatile int edf_stop;
+static l1_deadline_stats edf_stats;
+static l1_tid edf_periodic_tid;
+/* Background slices run while a job was released, and jobs run early */
+static int edf_overtaken;
+static int edf_early;
+
+void* edf_record(void* arg) {
+  edf_order[edf_ran++] = (int)(long)arg;
+  return NULL;
+}
+
+/* Background work, until edf_stop */
+void* edf_background(void* arg) {
+  l1_time start, now;
+
+  while (!edf_stop) {
+    l1_time_get(&start);
+    do {
+      l1_time_get(&now);
+    } while (now - start < SHARE_QUANTUM);
+    yield(-1);
+    /* A released job runs ahead of the background */
+    if (get_thread(edf_periodic_tid)->state == RUNNABLE)
+      edf_overtaken++;
+  }
+  return NULL;
+}
+
+void* edf_periodic(void* arg) {
+  for (int i = 0; i < EDF_JOBS; ++i) {
+    l1_thread_job_done();
+    if (l1_time_now_ns() < get_scheduler()->current->edf_release)
+      edf_early++;
+  }
+  l1_thread_deadline_stats(get_scheduler()->current->id, &edf_stats);
+  edf_stop = 1;
+  return NULL;
+}
+
+/* Overruns its 1 ms deadline by 2 ms */
+void* edf_overrun(void* arg) {
+  uint64_t end = l1_time_now_ns() + 3 * L1_TIME_MS;
+
+  while (l1_time_now_ns() < end);
+  l1_thread_job_done();
+  l1_thread_deadline_stats(get_scheduler()->current->id, &edf_stats);
+  return NULL;
+}
+
+START_TEST(edf_test) {
+  l1_tid tids[3];
+
+  /* Deadlines first, the earliest one first */
+  initialize_scheduler(l1_mlfq_policy);
+  for (long i = 0; i < 3; ++i)
+    l1_thread_create(&tids[i], edf_record, (void*)i);
+  l1_thread_set_deadline(tids[1], 10 * L1_TIME_MS, 0);
+  l1_thread_set_deadline(tids[2], 5 * L1_TIME_MS, 0);
+  schedule();
+  ck_assert_msg(edf_order[0] == 2 && edf_order[1] == 1 && edf_order[2] == 0,
+                "Threads should run by deadline, ahead of the policy.");
+  ck_assert(get_scheduler()->deadline_stats.jobs == 2);
+  ck_assert(get_scheduler()->deadline_stats.misses == 0);
+  clean_up_scheduler();
+
+  /* Periodic jobs are not released early, and once released they run ahead
+   * of the background work. Whether they meet their deadlines also depends
+   * on the other processes of the machine. */
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&tids[0], edf_background, NULL);
+  l1_thread_create(&tids[1], edf_background, NULL);
+  l1_thread_create(&edf_periodic_tid, edf_periodic, NULL);
+  l1_thread_set_deadline(edf_periodic_tid, 2 * L1_TIME_MS, 5 * L1_TIME_MS);
+  schedule();
+  clean_up_scheduler();
+  ck_assert(edf_stats.jobs == EDF_JOBS && edf_early == 0);
+  ck_assert_msg(edf_overtaken == 0, "Released jobs should run ahead of the policy.");
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&tids[0], edf_overrun, NULL);
+  l1_thread_set_deadline(tids[0], L1_TIME_MS, 0);
+  ck_assert(l1_thread_set_deadline(tids[0], 0, L1_TIME_MS) == ERRINVAL);
+  schedule();
+  ck_assert_msg(edf_stats.jobs == 1 && edf_stats.misses == 1 &&
+                edf_stats.max_lateness >= 2 * L1_TIME_MS,
+                "A late job should count as a miss.");
+  ck_assert(get_scheduler()->deadline_stats.misses == 1);
+  clean_up_scheduler();
+}
+END_TEST
+
+/* Nice 0, 5 and 10 */
+static void share_nice(l1_tid tid, int i) {
+  l1_thread_set_nice(tid, 5 * i);
+}
+
+/* Weights 1024, 335 and 110 */
+static const double nice_shares[SHARE_THREADS] = {
+  1024 / 1469.0, 335 / 1469.0, 110 / 1469.0
+};
+
+static uint64_t late_vruntime, late_min_vruntime;
+static uint64_t woken_vruntime, woken_min_vruntime;
+static l1_tid cfs_spinner_tid;
+
+/* Yields for 20 ms alone with the joiner blocked, then creates a thread */
+void* cfs_spinner(void* arg) {
+  uint64_t end = l1_time_now_ns() + 20 * L1_TIME_MS;
+  l1_tid tid;
+
+  while (l1_time_now_ns() < end)
+    yield(-1);
+  l1_thread_create(&tid, edf_record, NULL);
+  late_vruntime = get_thread(tid)->vruntime;
+  late_min_vruntime = get_scheduler()->min_vruntime;
+  return NULL;
+}
+
+void* cfs_joiner(void* arg) {
+  l1_thread_join(cfs_spinner_tid, NULL);
+  woken_vruntime = get_scheduler()->current->vruntime;
+  woken_min_vruntime = get_scheduler()->min_vruntime;
+  return NULL;
+}
+
+START_TEST(cfs_test) {
+  l1_tid tid;
+
+  ck_assert_msg(share_error(l1_cfs_policy, share_nice, nice_shares) < 0.05,
+                "CFS shares should be within 5%% of the weights.");
+
+  initialize_scheduler(l1_cfs_policy);
+  l1_thread_create(&tid, cfs_joiner, NULL);
+  l1_thread_create(&cfs_spinner_tid, cfs_spinner, NULL);
+  ck_assert(l1_thread_set_nice(tid, L1_NICE_MAX + 1) == ERRINVAL);
+  edf_ran = 0;
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(late_min_vruntime >= 10 * L1_TIME_MS && late_vruntime == late_min_vruntime,
+                "A new thread should start at min_vruntime.");
+  ck_assert_msg(woken_vruntime < woken_min_vruntime &&
+                woken_vruntime + CFS_SLEEPER_CREDIT >= woken_min_vruntime,
+                "A thread back from a join should get at most the sleeper credit.");
+}
+END_TEST
+
+#define TRACE_YIELDS 100
+
+static l1_tid traced[2];
+static l1_trace_event trace_events[4 * TRACE_YIELDS];
+
+void* trace_child(void* arg) {
+  for (int i = 0; i < TRACE_YIELDS; ++i)
+    yield(-1);
+  return NULL;
+}
+
+void* trace_parent(void* arg) {
+  l1_thread_create(&traced[1], trace_child, NULL);
+  l1_thread_join(traced[1], NULL);
+  return NULL;
+}
+
+START_TEST(trace_test) {
+  int creates = 0, joins = 0, switches = 0, dead = 0;
+  char* json;
+  size_t json_size;
+
+  ck_assert(l1_trace_start(16) == ERRINVAL);
+  initialize_scheduler(l1_round_robin_policy);
+  ck_assert(l1_trace_start(0) == ERRINVAL);
+  ck_assert(l1_trace_start(4 * TRACE_YIELDS) == SUCCESS);
+  ck_assert(l1_trace_start(4 * TRACE_YIELDS) == ERRINVAL);
+  l1_thread_create(&traced[0], trace_parent, NULL);
+  schedule();
+
+  size_t count = l1_trace_read(get_scheduler()->trace, trace_events, 4 * TRACE_YIELDS);
+  for (size_t i = 0; i < count; ++i) {
+    l1_trace_event* event = &trace_events[i];
+
+    ck_assert(i == 0 || event->time >= trace_events[i - 1].time);
+    creates += event->type == L1_TRACE_CREATE;
+    joins += event->type == L1_TRACE_JOIN && event->tid == traced[0] && event->arg == traced[1];
+    switches += event->type == L1_TRACE_SWITCH;
+    dead += event->type == L1_TRACE_STATE && event->tid == traced[1] &&
+            event->from == ZOMBIE && event->to == DEAD;
+  }
+  ck_assert_msg(creates == 2 && joins == 1 && dead == 1 && switches > TRACE_YIELDS,
+                "The trace should record creates, joins, switches and states.");
+
+  FILE* out = open_memstream(&json, &json_size);
+  ck_assert(l1_trace_write_json(trace_events, count, out) == SUCCESS);
+  fclose(out);
+  ck_assert_msg(strstr(json, "\"traceEvents\"") && strstr(json, "\"ph\":\"X\"") &&
+                strstr(json, "\"name\":\"join\""),
+                "The JSON trace should have running slices and instants.");
+  free(json);
+  clean_up_scheduler();
+
+  /* A full ring keeps the last events */
+  initialize_scheduler(l1_round_robin_policy);
+  l1_trace_start(10);
+  l1_thread_create(&traced[1], trace_child, NULL);
+  schedule();
+  l1_trace_ring* ring = get_scheduler()->trace;
+  ck_assert(ring->mask == 15 && ring->head > 16);
+  ck_assert(l1_trace_read(ring, trace_events, 4 * TRACE_YIELDS) == 15);
+  /* The finished thread leaves nothing to pick */
+  ck_assert(trace_events[14].type == L1_TRACE_PICK && trace_events[14].tid == (l1_tid)-1);
+  ck_assert(l1_trace_read(ring, trace_events + 15, 4) == 4);
+  ck_assert(memcmp(trace_events + 11, trace_events + 15, 4 * sizeof(l1_trace_event)) == 0);
+  clean_up_scheduler();
+}
+END_TEST
 
 int main(int argc, char **argv) {
     Suite* s = suite_create("Threading lab");
     TCase *tc1 = tcase_create("basic"); 
-    /* Your code here to test scheduling policies */
+    suite_add_tcase(s,tc1);
+
+    tcase_add_test(tc1, direct_switch_test);
+    tcase_add_test(tc1, park_switch_test);
+    tcase_add_test(tc1, mlfq_run_queue_test);
+    tcase_add_test(tc1, thread_heap_test);
+    tcase_add_test(tc1, smallest_cycles_test);
+    tcase_add_test(tc1, mn_fork_join_test);
+    tcase_add_test(tc1, deque_test);
+    tcase_add_test(tc1, mn_steal_test);
+    tcase_add_test(tc1, io_wait_test);
+    tcase_add_test(tc1, timer_wheel_test);
+    tcase_add_test(tc1, sleep_test);
+    tcase_add_test(tc1, mutex_test);
+    tcase_add_test(tc1, cond_sem_test);
+    tcase_add_test(tc1, mn_sync_test);
+    tcase_add_test(tc1, chan_test);
+    tcase_add_test(tc1, chan_select_test);
+#ifndef L1_SPLIT_STACK
+    tcase_add_test(tc1, chan_shared_stack_test);
+#endif
+    tcase_add_test(tc1, mn_chan_test);
+    tcase_add_test(tc1, preempt_test);
+    tcase_add_test(tc1, preempt_join_test);
+    tcase_add_test(tc1, stride_share_test);
+    tcase_add_test(tc1, edf_test);
+    tcase_add_test(tc1, cfs_test);
+    tcase_add_test(tc1, trace_test);
+    tcase_add_test(tc1, coro_generator_test);
+    tcase_add_test(tc1, coro_nested_test);
+    tcase_add_test(tc1, coro_threads_test);
 
     SRunner *sr = srunner_create(s); 
     srunner_run_all(sr, CK_VERBOSE); 
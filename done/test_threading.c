@@ -5,15 +5,473 @@
  * @author Mark Sutherland
  */
 #include <check.h>
+#include <stdio.h>
 #include <stdlib.h> 
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "schedule.h"
+#include "sched_policy.h"
+#include "stack.h"
+#include "stack_stats.h"
+#include "thread.h"
+
+/* 100k threads are spawned in waves: every guarded stack takes two memory
+ * mappings, and vm.max_map_count defaults to 65530 */
+#define RSS_THREADS 100000
+#define RSS_WAVE    10000
+
+/* Returns the VmHWM (peak RSS) of the process in KiB, or 0 if unknown */
+static long peak_rss_kib(void) {
+  FILE* status = fopen("/proc/self/status", "r");
+  char line[128];
+  long rss = 0;
+
+  if (status == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), status) != NULL) {
+    if (strncmp(line, "VmHWM:", 6) == 0) {
+      rss = strtol(line + 6, NULL, 10);
+      break;
+    }
+  }
+  fclose(status);
+  return rss;
+}
+
+/* Uses a little stack, like a typical short-lived green thread */
+void* rss_child(void* arg) {
+  volatile char buf[512];
+  memset((char*)buf, 0, sizeof(buf));
+  return arg;
+}
+
+void* rss_parent(void* arg) {
+  static l1_tid children[RSS_WAVE];
+  long* spawned = arg;
+
+  for (int wave = 0; wave < RSS_THREADS / RSS_WAVE; ++wave) {
+    for (int i = 0; i < RSS_WAVE; ++i) {
+      if (l1_thread_create(&children[i], rss_child, NULL) != SUCCESS)
+        return NULL;
+    }
+    for (int i = 0; i < RSS_WAVE; ++i) {
+      if (l1_thread_join(children[i], NULL) != SUCCESS)
+        return NULL;
+      ++*spawned;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(stack_rss_test) {
+  long spawned = 0;
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  ck_assert_msg(l1_thread_create(&parent, rss_parent, &spawned) == SUCCESS,
+                "Creating the parent thread should succeed.");
+  schedule();
+  clean_up_scheduler();
+
+  long rss = peak_rss_kib();
+  printf("stack_rss_test: %ld threads, %d live at once, peak RSS %ld KiB\n",
+         spawned, RSS_WAVE, rss);
+
+  ck_assert_msg(spawned == RSS_THREADS, "All threads should run and be joined.");
+  /* Reserved stacks alone would need RSS_WAVE * STACK_SIZE bytes */
+  ck_assert_msg(rss < (long)RSS_WAVE * (STACK_SIZE / 1024) / 8,
+                "Stacks should only be committed as they are used.");
+}
+END_TEST
+
+#ifndef L1_SPLIT_STACK
+START_TEST(stack_cache_test) {
+  l1_stack* first = l1_stack_new();
+  ck_assert_msg(first != NULL, "Allocating a stack should succeed.");
+  l1_stack_push(first, 42);
+  l1_stack_free(first);
+
+  l1_stack* second = l1_stack_new();
+  ck_assert_msg(second == first, "A freed stack should be reused.");
+  ck_assert_msg(l1_stack_is_empty(second), "A reused stack should be empty.");
+  ck_assert_msg(second->top == second->base + second->capacity,
+                "A reused stack should point to its top.");
+  l1_stack_free(second);
+  l1_stack_cache_clear();
+}
+END_TEST
+
+START_TEST(stack_size_class_test) {
+  ck_assert_msg(l1_stack_new_sized(STACK_MAX_SIZE + 1) == NULL,
+                "Stacks larger than the largest class should fail.");
+
+  l1_stack* medium = l1_stack_new_sized(20 * 1024);
+  ck_assert_msg(medium != NULL, "Allocating a stack should succeed.");
+  ck_assert_msg(medium->capacity * sizeof(uint64_t) == 4 * STACK_MIN_SIZE,
+                "The size should be rounded up to the next class.");
+  l1_stack_free(medium);
+
+  l1_stack* small = l1_stack_new_sized(STACK_MIN_SIZE);
+  ck_assert_msg(small != medium, "A stack should only be reused by its class.");
+  ck_assert_msg(l1_stack_new_sized(4 * STACK_MIN_SIZE) == medium,
+                "A stack should be reused by its class.");
+  l1_stack_free(small);
+  l1_stack_free(medium);
+  l1_stack_cache_clear();
+}
+END_TEST
+
+/* Number of the pages of [start, start + size) in RAM */
+static size_t resident_pages(void* start, size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  unsigned char vec[STACK_MAX_SIZE / 4096];
+  size_t resident = 0;
+
+  if (mincore(start, size, vec) != 0)
+    return SIZE_MAX;
+  for (size_t i = 0; i < (size + page - 1) / page; ++i)
+    resident += vec[i] & 1;
+  return resident;
+}
+
+START_TEST(stack_cache_release_test) {
+  size_t size = STACK_MAX_SIZE;
+  l1_stack* deep = l1_stack_new_sized(size);
+
+  /* As if a thread had used all of it */
+  memset(deep->base, 1, size);
+  ck_assert(resident_pages(deep->base, size) == size / sysconf(_SC_PAGESIZE));
+  l1_stack_free(deep);
+
+  l1_stack* reused = l1_stack_new_sized(size);
+  ck_assert(reused == deep);
+  ck_assert_msg(resident_pages(reused->base, size - STACK_CACHE_KEEP_SIZE) == 0,
+                "A cached stack should give its pages back.");
+  ck_assert_msg(reused->base[0] == 0, "Released pages should read as zeros.");
+  l1_stack_free(reused);
+  l1_stack_cache_clear();
+}
+END_TEST
+#endif
+
+void* capacity_child(void* arg) {
+  return (void*)(uintptr_t)get_scheduler()->current->thread_stack->capacity;
+}
+
+void* capacity_parent(void* arg) {
+  l1_thread_attr attr;
+  l1_tid child;
+  uintptr_t* capacities = arg;
+
+  l1_thread_attr_init(&attr);
+  attr.stack_size = STACK_MIN_SIZE;
+  l1_thread_create_ex(&child, &attr, capacity_child, NULL);
+  l1_thread_join(child, (void**)&capacities[0]);
+  l1_thread_create_ex(&child, NULL, capacity_child, NULL);
+  l1_thread_join(child, (void**)&capacities[1]);
+  return NULL;
+}
+
+START_TEST(thread_stack_size_test) {
+  uintptr_t capacities[2] = { 0 };
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, capacity_parent, capacities);
+  schedule();
+  clean_up_scheduler();
+
+#ifndef L1_SPLIT_STACK
+  ck_assert_msg(capacities[0] == STACK_MIN_SIZE / sizeof(uint64_t),
+                "A thread should get the stack size it asked for.");
+  ck_assert_msg(capacities[1] == MAX_STACK_CAPACITY,
+                "A thread should get STACK_SIZE by default.");
+#else
+  ck_assert_msg(capacities[0] != 0 && capacities[1] != 0, "Threads should get a stack.");
+#endif
+}
+END_TEST
+
+void* zombie_child(void* arg) {
+  return arg;
+}
+
+void* zombie_parent(void* arg) {
+  l1_tid child;
+  bool* released = arg;
+
+  if (l1_thread_create(&child, zombie_child, NULL) != SUCCESS)
+    return NULL;
+  /* Let the child finish without joining it yet */
+  yield(-1);
+  l1_thread_info* zombie = thread_list_find(&get_scheduler()->thread_arrays[ZOMBIE], child);
+  *released = (zombie != NULL && zombie->thread_stack == NULL);
+  l1_thread_join(child, NULL);
+  return NULL;
+}
+
+START_TEST(zombie_stack_release_test) {
+  bool released = false;
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, zombie_parent, &released);
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(released, "A zombie should release its stack before being joined.");
+}
+END_TEST
+
+#define TID_TEST_THREADS 1000
+
+void* tid_parent(void* arg) {
+  static l1_tid children[TID_TEST_THREADS];
+  l1_tid* tids = arg;
+
+  for (int i = 0; i < TID_TEST_THREADS; ++i) {
+    if (l1_thread_create(&children[i], zombie_child, NULL) != SUCCESS)
+      return NULL;
+  }
+  for (int i = 0; i < TID_TEST_THREADS; ++i) {
+    if (!get_thread(children[i]) || get_thread(children[i])->id != children[i])
+      return NULL;
+  }
+  for (int i = 0; i < TID_TEST_THREADS; ++i)
+    l1_thread_join(children[i], NULL);
+  /* The children are reaped, their IDs get reused */
+  tids[0] = children[0];
+  if (l1_thread_create(&tids[1], zombie_child, NULL) != SUCCESS)
+    return NULL;
+  tids[2] = get_thread(tids[0]) == NULL && l1_thread_join(tids[0], NULL) == ERRINVAL;
+  l1_thread_join(tids[1], NULL);
+  return NULL;
+}
+
+START_TEST(tid_recycling_test) {
+  l1_tid tids[3] = { 0 };
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, tid_parent, tids);
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(tids[1] != tids[0] && (tids[1] & TID_INDEX_MASK) == (tids[0] & TID_INDEX_MASK),
+                "A reused thread ID should get a new generation.");
+  ck_assert_msg(tids[2], "A stale thread ID should not name a thread.");
+}
+END_TEST
+
+#define MULTI_JOINERS 3
+
+static l1_tid multi_target;
+
+void* multi_join_target(void* arg) {
+  /* Let all the joiners block on us */
+  for (int i = 0; i < MULTI_JOINERS; ++i)
+    yield(-1);
+  return arg;
+}
+
+void* multi_joiner(void* arg) {
+  void** retval = arg;
+
+  if (l1_thread_join(multi_target, retval) != SUCCESS)
+    *retval = NULL;
+  return NULL;
+}
+
+void* multi_join_parent(void* arg) {
+  void** retvals = arg;
+  l1_tid joiners[MULTI_JOINERS];
+
+  if (l1_thread_create(&multi_target, multi_join_target, (void*)0x5eedL) != SUCCESS)
+    return NULL;
+  for (int i = 0; i < MULTI_JOINERS; ++i) {
+    if (l1_thread_create(&joiners[i], multi_joiner, &retvals[i]) != SUCCESS)
+      return NULL;
+  }
+  for (int i = 0; i < MULTI_JOINERS; ++i)
+    l1_thread_join(joiners[i], NULL);
+  /* The target was collected once all its joiners got its retval */
+  retvals[MULTI_JOINERS] = (void*)(long)(l1_thread_join(multi_target, NULL) == ERRINVAL);
+  return NULL;
+}
+
+START_TEST(multi_join_test) {
+  void* retvals[MULTI_JOINERS + 1] = { 0 };
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, multi_join_parent, retvals);
+  schedule();
+  clean_up_scheduler();
+
+  for (int i = 0; i < MULTI_JOINERS; ++i)
+    ck_assert_msg(retvals[i] == (void*)0x5eedL, "Every joiner should get the return value.");
+  ck_assert_msg(retvals[MULTI_JOINERS], "A collected thread should not be joined again.");
+}
+END_TEST
+
+#ifndef L1_SPLIT_STACK
+/* Keeps a running sum in a local array across yields */
+void* shared_child(void* arg) {
+  volatile long locals[64];
+  long n = (long)arg;
+
+  for (int i = 0; i < 64; ++i) {
+    locals[i] = n * i;
+    yield(-1);
+  }
+  long sum = 0;
+  for (int i = 0; i < 64; ++i)
+    sum += locals[i];
+  return (void*)sum;
+}
+
+void* shared_parent(void* arg) {
+  l1_tid children[4];
+  long* sums = arg;
+
+  for (long i = 0; i < 4; ++i) {
+    if (l1_thread_create_shared(&children[i], shared_child, (void*)(i + 1)) != SUCCESS)
+      return NULL;
+  }
+  for (int i = 0; i < 4; ++i)
+    l1_thread_join(children[i], (void**)&sums[i]);
+  return NULL;
+}
+
+START_TEST(shared_stack_test) {
+  long sums[4] = { 0 };
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, shared_parent, sums);
+  schedule();
+  clean_up_scheduler();
+
+  /* sum of n * i for i < 64 */
+  for (long n = 1; n <= 4; ++n)
+    ck_assert_msg(sums[n - 1] == n * 2016,
+                  "Shared-stack threads should keep their stack across switches.");
+}
+END_TEST
+#endif
+
+#ifdef L1_SPLIT_STACK
+#define DEEP_RECURSION 4096
+
+/* Recurses far deeper than a single segment, 1 KiB per frame, and yields
+ * at the bottom so that the other deep thread runs meanwhile.
+ * Returns depth. */
+int deep_recursion(int depth) {
+  volatile char frame[1024];
+  frame[0] = 1;
+  if (depth == 0) {
+    yield(-1);
+    return 0;
+  }
+  return deep_recursion(depth - 1) + frame[0];
+}
+
+void* deep_child(void* arg) {
+  *(int*)arg = deep_recursion(DEEP_RECURSION);
+  return NULL;
+}
+
+void* deep_parent(void* arg) {
+  l1_tid children[2];
+
+  /* Interleave two deep threads to switch between grown segment lists */
+  for (int i = 0; i < 2; ++i) {
+    if (l1_thread_create(&children[i], deep_child, (int*)arg + i) != SUCCESS)
+      return NULL;
+  }
+  for (int i = 0; i < 2; ++i)
+    l1_thread_join(children[i], NULL);
+  return NULL;
+}
+
+START_TEST(split_stack_growth_test) {
+  int results[2] = { -1, -1 };
+  l1_tid parent;
+
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, deep_parent, results);
+  schedule();
+  clean_up_scheduler();
+
+  ck_assert_msg(results[0] == DEEP_RECURSION && results[1] == DEEP_RECURSION,
+                "Threads should grow their stack past the first segment.");
+}
+END_TEST
+#endif
+
+/* Uses a bit more than 8 KiB of stack */
+void* watermark_child(void* arg) {
+  volatile char frame[8 * 1024];
+  memset((char*)frame, 1, sizeof(frame));
+  return NULL;
+}
+
+void* watermark_parent(void* arg) {
+  l1_tid children[3];
+
+  for (int i = 0; i < 3; ++i)
+    l1_thread_create(&children[i], watermark_child, NULL);
+  for (int i = 0; i < 3; ++i)
+    l1_thread_join(children[i], NULL);
+  return NULL;
+}
+
+START_TEST(stack_watermark_test) {
+  l1_tid parent;
+
+  l1_stack_set_watermarking(true);
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&parent, watermark_parent, NULL);
+  schedule();
+  l1_stack_stats_report(stdout);
+  clean_up_scheduler();
+  l1_stack_set_watermarking(false);
+
+  const l1_stack_stats* stats = l1_stack_stats_find(watermark_child);
+  ck_assert_msg(stats != NULL && stats->threads == 3,
+                "Every finished thread should be recorded.");
+#ifndef L1_SPLIT_STACK
+  /* With segmented stacks, the frame does not fit in the measured segment */
+  ck_assert_msg(stats->max >= 8 * 1024 && stats->max < 16 * 1024,
+                "The high-watermark should match the stack use.");
+  ck_assert_msg(stats->histogram[6] == 3,
+                "The threads should be in the [8 KiB, 16 KiB) bucket.");
+#endif
+}
+END_TEST
 
 int main(int argc, char **argv)
 {
     Suite* s = suite_create("Stack Library Tests");
     TCase *tc1 = tcase_create("basic"); 
     suite_add_tcase(s,tc1);
+    tcase_set_timeout(tc1, 120);
 
-    /* TODO: Write your own tests */
+    tcase_add_test(tc1, stack_rss_test);
+#ifdef L1_SPLIT_STACK
+    tcase_add_test(tc1, split_stack_growth_test);
+#else
+    tcase_add_test(tc1, stack_cache_test);
+    tcase_add_test(tc1, shared_stack_test);
+    tcase_add_test(tc1, stack_size_class_test);
+    tcase_add_test(tc1, stack_cache_release_test);
+#endif
+    tcase_add_test(tc1, thread_stack_size_test);
+    tcase_add_test(tc1, stack_watermark_test);
+    tcase_add_test(tc1, zombie_stack_release_test);
+    tcase_add_test(tc1, tid_recycling_test);
+    tcase_add_test(tc1, multi_join_test);
 
     SRunner *sr = srunner_create(s); 
     srunner_run_all(sr, CK_VERBOSE); 
@@ -5,34 +5,69 @@
  * @author Mark Sutherland
  */
 #include <stdlib.h>
+#include <time.h>
 #include "malloc.h"
+#include "preempt.h"
+#include "sched_mn.h"
 #include "schedule.h"
 #include "stack.h"
 #include "thread.h"
+#include "thread_heap.h"
 #include "thread_info.h"
+#include "timer_wheel.h"
 #include "priority.h"
 
+/* Counts a finished job of a thread with a deadline */
+static void end_job(l1_thread_info* thread) {
+  l1_deadline_stats* totals = &get_scheduler()->deadline_stats;
+  uint64_t now = l1_time_now_ns();
+
+  thread->edf_stats.jobs++;
+  totals->jobs++;
+  if (now > thread->edf_deadline) {
+    uint64_t lateness = now - thread->edf_deadline;
+
+    thread->edf_stats.misses++;
+    totals->misses++;
+    if (lateness > thread->edf_stats.max_lateness) thread->edf_stats.max_lateness = lateness;
+    if (lateness > totals->max_lateness) totals->max_lateness = lateness;
+  }
+}
+
 /* This is a function that calls a new thread's start_routine and stores the
  * return value in the function's info struct. This function is put on top
  * of the constructed stack for all new threads.
  */
 void l1_start(void) {
   l1_thread_info* cur = get_scheduler()->current;
+
+  /* Out of the critical section of the switch to the thread */
+  l1_critical_exit();
   /* enter execution */
   void* ret = cur->thread_func(cur->thread_func_args); 
   cur->retval = ret; 
+  /* Returning ends the current job */
+  if (cur->edf_deadline) {
+    end_job(cur);
+    cur->edf_deadline = 0;
+  }
   cur->state = ZOMBIE;
   /* Let the scheduler do the cleanup */
   yield(-1); 
 }
 
-l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg) {
+/* Creates a thread running on thread_stack, or frees the stack on failure */
+static l1_error l1_thread_create_on(l1_stack *thread_stack, l1_tid *thread,
+                                    void *(*start_routine)(void *), void *arg) {
   l1_tid new_tid = get_uniq_tid();
   /* TODO: Allocate l1_thread_info struct for new thread,
    * allocate stack for the thread. */
   l1_thread_info *new_t_info = (l1_thread_info *)libc_malloc(sizeof(l1_thread_info));
 
-  if (!new_t_info) {
+  if (!new_t_info || new_tid == (l1_tid)-1) {
+    libc_free(new_t_info);
+    if (new_tid != (l1_tid)-1) release_uniq_tid(new_tid);
+    l1_stack_free(thread_stack);
     l1_errno = ERRNOMEM;
     fprintf(stderr, "l1_thread_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
     return l1_errno;
@@ -42,12 +77,34 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   new_t_info->state = RUNNABLE;
   new_t_info->thread_func = start_routine;
   new_t_info->thread_func_args = arg;
-  new_t_info->thread_stack = l1_stack_new();
+  new_t_info->thread_stack = thread_stack;
+  new_t_info->coro = NULL;
+  new_t_info->exited = false;
+  new_t_info->joiners.head = new_t_info->joiners.tail = NULL;
+  new_t_info->wait_prev = new_t_info->wait_next = NULL;
+  new_t_info->io_fd = -1;
+  new_t_info->io_events = 0;
+  new_t_info->cond_mutex = NULL;
+  new_t_info->timer_prev = new_t_info->timer_next = NULL;
+  new_t_info->timer_slot = NULL;
 
   /* Initialize l1_time and scheduling-related variables */
   new_t_info->priority_level = TOP_PRIORITY;
   new_t_info->got_scheduled = 0;
+  new_t_info->rq_prev = new_t_info->rq_next = NULL;
+  new_t_info->rq_queued = false;
+  new_t_info->heap_index = THREAD_HEAP_NONE;
   new_t_info->total_time = 0;
+  new_t_info->tickets = L1_DEFAULT_TICKETS;
+  new_t_info->pass = 0;
+  new_t_info->stride_charged = 0;
+  /* Not ahead of the threads already there */
+  new_t_info->nice = 0;
+  new_t_info->vruntime = get_scheduler()->min_vruntime;
+  new_t_info->cfs_charged = 0;
+  new_t_info->edf_deadline = 0;
+  new_t_info->edf_period = 0;
+  new_t_info->edf_stats = (l1_deadline_stats){ 0, 0, 0 };
 
   /* TODO: Setup stack for new task. At the bottom of the stack is a fake stack 
    * frame for l1_start, as described in the handout. This will allow the 
@@ -59,6 +116,7 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
    * are saved by a function's caller and callee. 
    * See https://wiki.osdev.org/System_V_ABI
    * In `switch_asm`, we only save the registers are not already saved.
+   * The frame layout is documented in switch.S.
    */
   l1_stack_push(new_t_info->thread_stack, 0);
   l1_stack_push(new_t_info->thread_stack, (uint64_t)&l1_start);
@@ -68,6 +126,9 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   l1_stack_push(new_t_info->thread_stack, 0);  // %r13
   l1_stack_push(new_t_info->thread_stack, 0);  // %r12
   l1_stack_push(new_t_info->thread_stack, 0);  // %rbx
+#ifdef L1_SWITCH_FP
+  l1_stack_push(new_t_info->thread_stack, SWITCH_FP_DEFAULT_CONTROL);  // MXCSR, x87 CW
+#endif
 
   /* TODO: Add the new task for scheduling */
   add_to_scheduler(new_t_info, RUNNABLE);
@@ -78,24 +139,103 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   return SUCCESS;
 }
 
-l1_error l1_thread_join(l1_tid target, void **retval) {
+void l1_thread_attr_init(l1_thread_attr *attr) {
+  attr->stack_size = STACK_SIZE;
+  attr->shared_stack = false;
+}
+
+l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg) {
+  return l1_thread_create_ex(thread, NULL, start_routine, arg);
+}
+
+l1_error l1_thread_create_shared(l1_tid *thread, void *(*start_routine)(void *), void *arg) {
+  l1_thread_attr attr;
+
+  l1_thread_attr_init(&attr);
+  attr.shared_stack = true;
+  return l1_thread_create_ex(thread, &attr, start_routine, arg);
+}
+
+l1_error l1_thread_create_ex(l1_tid *thread, const l1_thread_attr *attr,
+                             void *(*start_routine)(void *), void *arg) {
+  l1_thread_attr default_attr;
+  l1_stack *thread_stack;
+
+  if (!attr) {
+    l1_thread_attr_init(&default_attr);
+    attr = &default_attr;
+  }
+
+  if (attr->stack_size > STACK_MAX_SIZE) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  if (attr->shared_stack) {
+    l1_scheduler_info* sched_info = get_scheduler();
+
+    /* Threads move between M:N workers, but the shared stack does not */
+    if (sched_info->worker) {
+      l1_errno = ERRINVAL;
+      fprintf(stderr, "l1_thread_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+      return l1_errno;
+    }
+
+    /* The shared stack is mapped on first use */
+    if (!sched_info->shared_stack) {
+      sched_info->shared_stack = l1_shared_stack_new();
+
+      if (!sched_info->shared_stack) {
+#ifdef L1_SPLIT_STACK
+        l1_errno = ERRINVAL;
+#else
+        l1_errno = ERRNOMEM;
+#endif
+        fprintf(stderr, "l1_thread_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+        return l1_errno;
+      }
+    }
+
+    thread_stack = l1_stack_new_on_shared(sched_info->shared_stack);
+  } else {
+    thread_stack = l1_stack_new_sized(attr->stack_size);
+  }
+
+  if (!thread_stack) {
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_thread_create(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  return l1_thread_create_on(thread_stack, thread, start_routine, arg);
+}
+
+/* Joins target, until deadline unless it is TIMER_WHEEL_NONE */
+static l1_error thread_join(l1_tid target, void **retval, uint64_t deadline) {
   /* TODO: Setup necessary metadata and block yourself */
   l1_scheduler_info* sched_info = get_scheduler();
   l1_thread_info *cur_t_info = sched_info->current;
 
-  if (!thread_list_find(sched_info->thread_arrays+RUNNABLE, target) && 
-      !thread_list_find(sched_info->thread_arrays+BLOCKED, target) && 
-      !thread_list_find(sched_info->thread_arrays+ZOMBIE, target)) {
+  if (sched_info->worker && deadline == TIMER_WHEEL_NONE) {
+    return l1_mn_join(target, retval);
+  }
+  if (sched_info->worker) {
     l1_errno = ERRINVAL;
-    fprintf(stderr, "l1_thread_join(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    fprintf(stderr, "l1_thread_join_timeout(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
     return l1_errno;
   }
 
-  if (thread_list_find(sched_info->thread_arrays+DEAD, target)) return SUCCESS;
+  l1_thread_info *target_t_info = get_thread(target);
 
-  cur_t_info->state = BLOCKED;
-  cur_t_info->joined_target = target;
-  cur_t_info->errno = SUCCESS;
+  /* Reaped threads are not in the table anymore */
+  if (!target_t_info || target_t_info->state == DEAD) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_join(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+
+  /* Before the thread blocks: nothing may switch it out in between */
   cur_t_info->join_recv = libc_malloc(sizeof(void *));
 
   if (!cur_t_info->join_recv) {
@@ -103,9 +243,22 @@ l1_error l1_thread_join(l1_tid target, void **retval) {
     fprintf(stderr, "l1_thread_join(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
     return l1_errno;
   }
+  cur_t_info->state = BLOCKED;
+  cur_t_info->joined_target = target;
+  cur_t_info->errno = SUCCESS;
 
+  /* Woken up with ERRTIMEDOUT once the deadline passes */
+  if (deadline != TIMER_WHEEL_NONE) {
+    timer_wheel_add(&sched_info->timers, cur_t_info, deadline);
+  }
   yield(cur_t_info->joined_target);
   
+  if (cur_t_info->errno == ERRTIMEDOUT) {
+    l1_errno = ERRTIMEDOUT;
+    libc_free(cur_t_info->join_recv);
+    cur_t_info->join_recv = NULL;
+    return l1_errno;
+  }
   if (cur_t_info->errno) {
     fprintf(stderr, "l1_thread_join(): errno %d %s\n", cur_t_info->errno, l1_strerror(cur_t_info->errno));
     return cur_t_info->errno;
@@ -127,3 +280,121 @@ l1_error l1_thread_join(l1_tid target, void **retval) {
 
   return SUCCESS;
 }
+
+l1_error l1_thread_join(l1_tid target, void **retval) {
+  return thread_join(target, retval, TIMER_WHEEL_NONE);
+}
+
+l1_error l1_thread_join_timeout(l1_tid target, void **retval, uint64_t timeout) {
+  return thread_join(target, retval, l1_time_now_ns() + timeout);
+}
+
+l1_error l1_thread_set_tickets(l1_tid tid, uint32_t tickets) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  l1_thread_info* thread = sched_info && !sched_info->worker ? get_thread(tid) : NULL;
+
+  if (!thread || thread->state == ZOMBIE || thread->state == DEAD ||
+      tickets == 0 || tickets > L1_MAX_TICKETS) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_set_tickets(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  /* The pass is unchanged, only how fast it advances from now on */
+  thread->tickets = tickets;
+  return SUCCESS;
+}
+
+l1_error l1_thread_set_nice(l1_tid tid, int nice) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  l1_thread_info* thread = sched_info && !sched_info->worker ? get_thread(tid) : NULL;
+
+  if (!thread || thread->state == ZOMBIE || thread->state == DEAD ||
+      nice < L1_NICE_MIN || nice > L1_NICE_MAX) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_set_nice(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  /* The vruntime is unchanged, only how fast it advances from now on */
+  thread->nice = nice;
+  return SUCCESS;
+}
+
+l1_error l1_thread_set_deadline(l1_tid tid, uint64_t deadline, uint64_t period) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  l1_thread_info* thread = sched_info && !sched_info->worker ? get_thread(tid) : NULL;
+
+  if (!thread || thread->state == ZOMBIE || thread->state == DEAD ||
+      (deadline == 0 && period != 0)) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_set_deadline(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  /* The first job is released now */
+  thread->edf_relative = deadline;
+  thread->edf_period = period;
+  thread->edf_release = l1_time_now_ns();
+  set_deadline(thread, deadline ? thread->edf_release + deadline : 0);
+  return SUCCESS;
+}
+
+l1_error l1_thread_job_done(void) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  l1_thread_info* cur_t_info = sched_info ? sched_info->current : NULL;
+
+  if (!cur_t_info || cur_t_info == sched_info->tsys || !cur_t_info->edf_deadline) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_job_done(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  end_job(cur_t_info);
+  if (cur_t_info->edf_period == 0) {
+    cur_t_info->edf_deadline = 0;
+    return SUCCESS;
+  }
+
+  /* Next job, which waits for its release unless this one overran */
+  cur_t_info->edf_release += cur_t_info->edf_period;
+  cur_t_info->edf_deadline = cur_t_info->edf_release + cur_t_info->edf_relative;
+  if (cur_t_info->edf_release > l1_time_now_ns()) {
+    return l1_sleep_until(cur_t_info->edf_release);
+  }
+  return SUCCESS;
+}
+
+l1_error l1_thread_deadline_stats(l1_tid tid, l1_deadline_stats* stats) {
+  l1_scheduler_info* sched_info = get_scheduler();
+  l1_thread_info* thread = sched_info && !sched_info->worker ? get_thread(tid) : NULL;
+
+  if (!thread || thread->state == DEAD) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_thread_deadline_stats(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  *stats = thread->edf_stats;
+  return SUCCESS;
+}
+
+l1_error l1_sleep_until(uint64_t deadline) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  if (!sched_info || sched_info->current == sched_info->tsys || sched_info->worker) {
+    struct timespec ts = { deadline / 1000000000ULL, deadline % 1000000000ULL };
+
+    /* Until the deadline, even if interrupted by signals */
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0 &&
+           l1_time_now_ns() < deadline);
+    return SUCCESS;
+  }
+
+  l1_thread_info* cur_t_info = sched_info->current;
+
+  /* Out of the run queue until the scheduler expires the deadline */
+  cur_t_info->state = SLEEPING;
+  timer_wheel_add(&sched_info->timers, cur_t_info, deadline);
+  yield(-1);
+  return SUCCESS;
+}
+
+l1_error l1_sleep_ns(uint64_t ns) {
+  return l1_sleep_until(l1_time_now_ns() + ns);
+}
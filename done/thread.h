@@ -6,9 +6,20 @@
  */
 
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "error.h"
 #include "thread_info.h"
 
+/**
+ * @brief Attributes of a new thread, see `l1_thread_create_ex`
+ */
+typedef struct {
+  size_t stack_size;    /** Minimum stack size in bytes, up to STACK_MAX_SIZE */
+  bool shared_stack;    /** Run on the shared stack, stack_size is then unused */
+} l1_thread_attr;
+
 /**
  * @brief Spawns a new green thread
  *
@@ -28,6 +39,56 @@
  */
 l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg);
 
+/**
+ * @brief Initializes thread attributes to the defaults of `l1_thread_create`
+ *
+ * The default is a private stack of STACK_SIZE bytes.
+ *
+ * @param  attr   The attributes to initialize
+ */
+void l1_thread_attr_init(l1_thread_attr *attr);
+
+/**
+ * @brief Spawns a new green thread with the given attributes
+ *
+ * Same as `l1_thread_create`, but the thread is set up according to attr.
+ * The requested stack size is rounded up to the next stack size class, so
+ * that stacks of each class are recycled through their own pool.
+ *
+ * A possible error is a stack size larger than STACK_MAX_SIZE (ERRINVAL).
+ *
+ * @param  thread           Pointer to a `l1_tid`.
+ * @param  attr             Thread attributes, or NULL for the defaults.
+ * @param  start_routine    This is the function that will be run on the 
+ *                          created thread. 
+ * @return  If successful, return SUCCESS. On error, it returns an error code
+ *          and the contents of *thread are undefined.
+ */
+l1_error l1_thread_create_ex(l1_tid *thread, const l1_thread_attr *attr,
+                             void *(*start_routine)(void *), void *arg);
+
+/**
+ * @brief Spawns a new green thread running on the shared stack
+ *
+ * Same as `l1_thread_create`, but the thread executes on a stack shared with
+ * all other shared-stack threads (see `l1_thread_attr`). When the thread is switched
+ * out and another shared-stack thread runs, only the live part of its stack
+ * is kept, in a heap buffer of the exact size. Memory per thread is then
+ * proportional to its actual stack depth, at the cost of a copy on switches.
+ *
+ * @warning The stack of such a thread moves while it is not running: other
+ * threads must not keep pointers to its local variables.
+ *
+ * Shared stacks are not available in segmented-stack mode (ERRINVAL).
+ *
+ * @param  thread           Pointer to a `l1_tid`.
+ * @param  start_routine    This is the function that will be run on the 
+ *                          created thread. 
+ * @return  If successful, return SUCCESS. On error, it returns an error code
+ *          and the contents of *thread are undefined.
+ */
+l1_error l1_thread_create_shared(l1_tid *thread, void *(*start_routine)(void *), void *arg);
+
 /**
  * @brief Blocks until a thread completes
  * 
@@ -38,7 +99,9 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
  * 
  * If `retval` is not NULL, then `l1_thread_join` copies the return value of 
  * the target thread into the location pointed to by `retval`. Multiple 
- * green threads should not try to join on the same target thread.
+ * green threads may join on the same target thread, they all get its return
+ * value. Once they are woken up, the target is collected, and joining it
+ * again fails.
  * 
  * A possible error is if the target thread does not exist (ERRINVAL).
  * 
@@ -48,3 +111,99 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
  * @return  If successful, return SUCCESS. On error, it returns an error code.
  */
 l1_error l1_thread_join(l1_tid target, void **retval);
+
+/**
+ * @brief `l1_thread_join`, giving up after timeout ns
+ *
+ * If the target has not finished by then, the function returns ERRTIMEDOUT
+ * without printing an error, and the target can still be joined. Timeouts
+ * are not available in M:N mode (ERRINVAL).
+ *
+ * @param  target   Target thread's ID
+ * @param  retval   This is where the return value of the target thread will
+ *                  be put
+ * @param  timeout  Maximum time to wait, in ns
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_thread_join_timeout(l1_tid target, void **retval, uint64_t timeout);
+
+/**
+ * @brief Sets the CPU share of a thread under `l1_stride_policy` and
+ * `l1_lottery_policy`
+ *
+ * Threads start with L1_DEFAULT_TICKETS tickets. Not available in M:N mode
+ * (ERRINVAL).
+ *
+ * @param  tid      Thread's ID
+ * @param  tickets  Number of tickets, from 1 to L1_MAX_TICKETS
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_thread_set_tickets(l1_tid tid, uint32_t tickets);
+
+/**
+ * @brief Sets the nice level of a thread under `l1_cfs_policy`
+ *
+ * Threads start at nice 0. Not available in M:N mode (ERRINVAL).
+ *
+ * @param  tid   Thread's ID
+ * @param  nice  From L1_NICE_MIN (largest share) to L1_NICE_MAX
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_thread_set_nice(l1_tid tid, int nice);
+
+/**
+ * @brief Puts a thread in the earliest deadline first class, or takes it out
+ *
+ * Threads with a deadline run ahead of the scheduler policy, the one with the
+ * earliest deadline first. The first job of the thread is released now and
+ * must finish `deadline` ns later. A job ends with `l1_thread_job_done`, or
+ * when the thread returns. With a period, the next job is released `period`
+ * ns after the previous release, and `l1_thread_job_done` sleeps until then.
+ * Without one, the thread goes back to the policy after its job.
+ *
+ * Jobs which end after their deadline count as misses, in the thread (see
+ * `l1_thread_deadline_stats`) and in the scheduler's `deadline_stats`. Not
+ * available in M:N mode (ERRINVAL).
+ *
+ * @param  tid       Thread's ID
+ * @param  deadline  Relative deadline of each job, in ns, 0 to leave the
+ *                   class
+ * @param  period    Time between job releases, in ns, 0 for a single job
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_thread_set_deadline(l1_tid tid, uint64_t deadline, uint64_t period);
+
+/**
+ * @brief Ends the current job of the calling thread, see
+ * `l1_thread_set_deadline`
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ *          ERRINVAL if the thread has no deadline
+ */
+l1_error l1_thread_job_done(void);
+
+/**
+ * @brief Copies the job counts of a thread with deadlines into stats
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error l1_thread_deadline_stats(l1_tid tid, l1_deadline_stats* stats);
+
+/**
+ * @brief Sleeps until the CLOCK_MONOTONIC time deadline, in ns (see
+ * `l1_time_now_ns`)
+ *
+ * The thread leaves the run queue until its deadline passes, and other
+ * threads run meanwhile. Outside of a green thread, and in M:N mode, the
+ * OS thread sleeps instead.
+ *
+ * @return  SUCCESS
+ */
+l1_error l1_sleep_until(uint64_t deadline);
+
+/**
+ * @brief Sleeps for ns nanoseconds, see `l1_sleep_until`
+ *
+ * @return  SUCCESS
+ */
+l1_error l1_sleep_ns(uint64_t ns);
@@ -0,0 +1,99 @@
+/**
+ * @file thread_heap.c
+ * @brief Implementation of the min-heap of threads
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_heap.h"
+
+static bool heap_less(l1_thread_info* a, l1_thread_info* b) {
+  if (a->heap_key != b->heap_key) {
+    return a->heap_key < b->heap_key;
+  }
+  return a->heap_seq < b->heap_seq;
+}
+
+static void heap_set(l1_thread_heap* heap, size_t i, l1_thread_info* thread) {
+  heap->threads[i] = thread;
+  thread->heap_index = i;
+}
+
+static void heap_sift_up(l1_thread_heap* heap, size_t i) {
+  l1_thread_info* thread = heap->threads[i];
+
+  while (i > 0) {
+    size_t parent = (i - 1) / THREAD_HEAP_ARITY;
+
+    if (!heap_less(thread, heap->threads[parent])) break;
+    heap_set(heap, i, heap->threads[parent]);
+    i = parent;
+  }
+  heap_set(heap, i, thread);
+}
+
+static void heap_sift_down(l1_thread_heap* heap, size_t i) {
+  l1_thread_info* thread = heap->threads[i];
+
+  for (;;) {
+    size_t first = i * THREAD_HEAP_ARITY + 1;
+    size_t min = i;
+    l1_thread_info* min_thread = thread;
+
+    for (size_t c = first; c < first + THREAD_HEAP_ARITY && c < heap->size; ++c) {
+      if (heap_less(heap->threads[c], min_thread)) {
+        min = c;
+        min_thread = heap->threads[c];
+      }
+    }
+    if (min == i) break;
+    heap_set(heap, i, min_thread);
+    i = min;
+  }
+  heap_set(heap, i, thread);
+}
+
+l1_error thread_heap_push(l1_thread_heap* heap, l1_thread_info* thread) {
+  if (heap->size == heap->capacity) {
+    size_t capacity = heap->capacity ? 2 * heap->capacity : THREAD_HEAP_INITIAL_CAPACITY;
+    l1_thread_info** threads = realloc(heap->threads, capacity * sizeof(l1_thread_info*));
+
+    if (!threads) {
+      return ERRNOMEM;
+    }
+    heap->threads = threads;
+    heap->capacity = capacity;
+  }
+  thread->heap_seq = heap->seq++;
+  heap->threads[heap->size] = thread;
+  heap_sift_up(heap, heap->size++);
+  return SUCCESS;
+}
+
+l1_thread_info* thread_heap_min(l1_thread_heap* heap) {
+  return heap->size ? heap->threads[0] : NULL;
+}
+
+void thread_heap_remove(l1_thread_heap* heap, l1_thread_info* thread) {
+  size_t i = thread->heap_index;
+
+  if (i >= heap->size || heap->threads[i] != thread) {
+    return;
+  }
+  thread->heap_index = THREAD_HEAP_NONE;
+  if (i == --heap->size) {
+    return;
+  }
+  /* Move the last thread into the hole, and restore the order around it */
+  heap->threads[i] = heap->threads[heap->size];
+  if (i > 0 && heap_less(heap->threads[i], heap->threads[(i - 1) / THREAD_HEAP_ARITY])) {
+    heap_sift_up(heap, i);
+  } else {
+    heap_sift_down(heap, i);
+  }
+}
+
+void thread_heap_free(l1_thread_heap* heap) {
+  free(heap->threads);
+  memset(heap, 0, sizeof(l1_thread_heap));
+}
@@ -0,0 +1,49 @@
+/**
+ * @file thread_heap.h
+ * @brief Min-heap of threads, for policies which run the thread with the
+ * smallest key next
+ *
+ * The heap is 4-ary, which makes it shallower than a binary heap for the
+ * same number of threads. A thread records its position in the heap, so
+ * that any thread can be removed in O(log n). Threads with equal keys come
+ * out in insertion order.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "error.h"
+#include "thread_info.h"
+
+#define THREAD_HEAP_ARITY 4
+#define THREAD_HEAP_INITIAL_CAPACITY 64
+/* heap_index of a thread which is not in a heap */
+#define THREAD_HEAP_NONE SIZE_MAX
+
+typedef struct {
+  l1_thread_info** threads;     /** Heap array */
+  size_t size;                  /** Number of threads in the heap */
+  size_t capacity;              /** Size of the heap array */
+  uint64_t seq;                 /** Insertion counter, to break ties */
+} l1_thread_heap;
+
+/**
+ * @brief Inserts a thread, ordered by its heap_key
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error thread_heap_push(l1_thread_heap* heap, l1_thread_info* thread);
+
+/**
+ * @brief Returns the thread with the smallest key, NULL if the heap is empty
+ */
+l1_thread_info* thread_heap_min(l1_thread_heap* heap);
+
+/**
+ * @brief Removes a thread from the heap, if it is in it
+ */
+void thread_heap_remove(l1_thread_heap* heap, l1_thread_info* thread);
+
+/**
+ * @brief Frees the memory of the heap
+ */
+void thread_heap_free(l1_thread_heap* heap);
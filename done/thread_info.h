@@ -5,6 +5,7 @@
  * @author Mark Sutherland
  */
 #pragma once
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include "error.h"
@@ -22,10 +23,30 @@ typedef enum  {
   BLOCKED,              /* Blocked on another process */
   ZOMBIE,               /* Zombie state waiting for one join */
   DEAD,                 /* Thread has been joined on and is ready to be collected */
+  IO_WAIT,              /* Waiting for a file descriptor to be ready, see io.h */
+  SLEEPING,             /* Waiting for a deadline, see timer_wheel.h */
+  WAITING,              /* Waiting on a mutex, condition or semaphore, see sync.h */
   NUM_THREAD_STATES     
 } l1_thread_state;
 typedef uint32_t l1_tid;
 
+/**
+ * @brief A FIFO queue of blocked threads, see wait_queue.h
+ */
+typedef struct l1_wait_queue {
+  struct l1_thread_info* head;    /** First thread to wake up */
+  struct l1_thread_info* tail;    /** Last thread to wake up */
+} l1_wait_queue;
+
+/**
+ * @brief Jobs of a thread with deadlines, see `l1_thread_set_deadline`
+ */
+typedef struct {
+  uint64_t jobs;                  /** Jobs finished */
+  uint64_t misses;                /** Jobs finished after their deadline */
+  uint64_t max_lateness;          /** Largest lateness of a missed job, in ns */
+} l1_deadline_stats;
+
 typedef struct l1_thread_info {
   l1_tid id;                      /** Thread ID */
   l1_thread_state state;          /** Thread state */
@@ -46,6 +67,20 @@ typedef struct l1_thread_info {
   l1_error errno;                 /** Per-thread errno */
   void* retval;                   /** Value returned by the thread */
   void** join_recv;               /** Pointer to put joined thread's return val */
+  l1_wait_queue joiners;          /** Threads blocked joining this one */
+  bool exited;                    /** M:N: finished and switched out, see sched_mn.h */
+  struct l1_thread_info* wait_prev; /** Previous thread in the same wait queue */
+  struct l1_thread_info* wait_next; /** Next thread in the same wait queue */
+  struct l1_coro* coro;           /** Coroutine the thread is running, NULL if none */
+  int io_fd;                      /** IO_WAIT: fd the thread waits for */
+  uint32_t io_events;             /** IO_WAIT: events waited for, then the ready ones (0: timeout) */
+  struct l1_mutex* cond_mutex;    /** WAITING on a condition: mutex to get back */
+
+  /* Links in the scheduler's timer wheel, see timer_wheel.h */
+  struct l1_thread_info* timer_prev;  /** Previous thread in the same slot */
+  struct l1_thread_info* timer_next;  /** Next thread in the same slot */
+  struct l1_thread_info** timer_slot; /** Slot of the thread, NULL if not in the wheel */
+  uint64_t timer_tick;            /** Tick the thread expires at */
 
   /* Scheduling information */
   l1_priority priority_level;     /** Priority level for the scheduler */
@@ -53,4 +88,33 @@ typedef struct l1_thread_info {
   l1_time total_time;             /** Total execution time so far */
   l1_time slice_start;       /** Start time it was last scheduled */
   l1_time slice_end;         /**End time it was last descheduled */
+  uint64_t preempt_ticks;         /** Preemption ticks in this slice, see preempt.h */
+
+  /* Links in the MLFQ run queue, see run_queue.h */
+  struct l1_thread_info* rq_prev; /** Previous thread at the same level */
+  struct l1_thread_info* rq_next; /** Next thread at the same level */
+  bool rq_queued;                 /** The thread is in the run queue */
+  uint64_t rq_boosts;             /** Run queue boosts when it was queued */
+
+  /* Position in the policy's heap, see thread_heap.h */
+  uint64_t heap_key;              /** Key the heap is ordered by */
+  uint64_t heap_seq;              /** Insertion order, for equal keys */
+  size_t heap_index;              /** Index in the heap */
+
+  /* Proportional share, see l1_stride_policy and l1_lottery_policy */
+  uint32_t tickets;               /** Share of the CPU */
+  uint64_t pass;                  /** Stride: virtual time the thread reached */
+  l1_time stride_charged;         /** Stride: total_time already added to pass */
+
+  /* Weighted fair share, see l1_cfs_policy */
+  int nice;                       /** Nice level, the lower the larger the share */
+  uint64_t vruntime;              /** Run time weighted by the nice level */
+  l1_time cfs_charged;            /** total_time already added to vruntime */
+
+  /* Earliest deadline first class, see l1_thread_set_deadline */
+  uint64_t edf_deadline;          /** Deadline of the current job, 0 if none */
+  uint64_t edf_relative;          /** Deadline of each job after its release */
+  uint64_t edf_period;            /** Time between releases, 0 for a single job */
+  uint64_t edf_release;           /** Release time of the current job */
+  l1_deadline_stats edf_stats;    /** Jobs finished and missed */
 } l1_thread_info;
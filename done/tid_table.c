@@ -0,0 +1,132 @@
+/**
+ * @file tid_table.c
+ * @brief Implementation of thread ID allocation and lookup
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "tid_table.h"
+
+/* Fibonacci hashing, IDs are mostly consecutive indices */
+static size_t tid_hash(l1_tid_table* table, l1_tid tid) {
+  return (size_t)((tid * 0x9e3779b97f4a7c15ULL) >> 32) & (table->capacity - 1);
+}
+
+l1_tid tid_table_alloc(l1_tid_table* table) {
+  if (table->free_count) {
+    l1_tid tid = table->free_tids[table->free_head];
+
+    table->free_head = (table->free_head + 1) % table->free_capacity;
+    table->free_count--;
+    /* Same index, next generation */
+    return tid + (1U << TID_INDEX_BITS);
+  }
+  if (table->next_index == TID_MAX_THREADS) {
+    return -1;
+  }
+  return table->next_index++;
+}
+
+void tid_table_release(l1_tid_table* table, l1_tid tid) {
+  if (table->free_count == table->free_capacity) {
+    size_t capacity = table->free_capacity ? 2 * table->free_capacity : TID_INITIAL_CAPACITY;
+    l1_tid* ring = malloc(capacity * sizeof(l1_tid));
+
+    /* The ID is lost, the index is never reused */
+    if (!ring) {
+      return;
+    }
+    for (size_t i = 0; i < table->free_count; ++i)
+      ring[i] = table->free_tids[(table->free_head + i) % table->free_capacity];
+    free(table->free_tids);
+    table->free_tids = ring;
+    table->free_head = 0;
+    table->free_capacity = capacity;
+  }
+  table->free_tids[(table->free_head + table->free_count) % table->free_capacity] = tid;
+  table->free_count++;
+}
+
+/* Returns the entry of tid, or the empty entry where it would go */
+static l1_tid_entry* tid_table_probe(l1_tid_table* table, l1_tid tid) {
+  size_t i = tid_hash(table, tid);
+
+  while (table->entries[i].thread && table->entries[i].tid != tid)
+    i = (i + 1) & (table->capacity - 1);
+  return &table->entries[i];
+}
+
+/* Doubles the capacity of the table, and rehashes all entries */
+static l1_error tid_table_grow(l1_tid_table* table) {
+  l1_tid_table grown = *table;
+
+  grown.capacity = table->capacity ? 2 * table->capacity : TID_INITIAL_CAPACITY;
+  grown.entries = calloc(grown.capacity, sizeof(l1_tid_entry));
+  if (!grown.entries) {
+    return ERRNOMEM;
+  }
+  for (size_t i = 0; i < table->capacity; ++i) {
+    if (table->entries[i].thread)
+      *tid_table_probe(&grown, table->entries[i].tid) = table->entries[i];
+  }
+  free(table->entries);
+  *table = grown;
+  return SUCCESS;
+}
+
+l1_error tid_table_insert(l1_tid_table* table, l1_thread_info* thread) {
+  /* Keep the load factor under 1/2 */
+  if (2 * (table->size + 1) > table->capacity && tid_table_grow(table) != SUCCESS) {
+    return ERRNOMEM;
+  }
+
+  l1_tid_entry* entry = tid_table_probe(table, thread->id);
+
+  if (!entry->thread) {
+    table->size++;
+  }
+  entry->tid = thread->id;
+  entry->thread = thread;
+  return SUCCESS;
+}
+
+l1_thread_info* tid_table_find(l1_tid_table* table, l1_tid tid) {
+  if (!table->size) {
+    return NULL;
+  }
+  return tid_table_probe(table, tid)->thread;
+}
+
+void tid_table_remove(l1_tid_table* table, l1_tid tid) {
+  if (!table->size) {
+    return;
+  }
+
+  size_t mask = table->capacity - 1;
+  l1_tid_entry* hole = tid_table_probe(table, tid);
+
+  if (!hole->thread) {
+    return;
+  }
+  hole->thread = NULL;
+  table->size--;
+
+  /* Shift back the following entries of the cluster which probed past the
+   * hole, so that lookups do not need tombstones */
+  size_t h = hole - table->entries;
+  for (size_t i = (h + 1) & mask; table->entries[i].thread; i = (i + 1) & mask) {
+    size_t home = tid_hash(table, table->entries[i].tid);
+
+    /* The entry can move to h if h lies cyclically in [home, i) */
+    if (((i - home) & mask) >= ((i - h) & mask)) {
+      table->entries[h] = table->entries[i];
+      table->entries[i].thread = NULL;
+      h = i;
+    }
+  }
+}
+
+void tid_table_free(l1_tid_table* table) {
+  free(table->entries);
+  free(table->free_tids);
+  memset(table, 0, sizeof(l1_tid_table));
+}
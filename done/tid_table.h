@@ -0,0 +1,71 @@
+/**
+ * @file tid_table.h
+ * @brief Thread ID allocation and lookup
+ *
+ * Live threads are indexed by ID in an open-addressing hash table, so that
+ * finding a thread takes O(1) whatever its state.
+ *
+ * A thread ID is made of an index and a generation. The IDs of reaped
+ * threads are reused, oldest first, with their generation incremented, so
+ * an ID never wraps into a live thread, and a stale ID does not name the
+ * next thread with the same index until the generation wraps.
+ */
+#pragma once
+#include <stddef.h>
+#include "thread_info.h"
+
+#define TID_INDEX_BITS 20
+#define TID_INDEX_MASK ((1U << TID_INDEX_BITS) - 1)
+/* The last index is never used, so that no thread gets ID -1 */
+#define TID_MAX_THREADS TID_INDEX_MASK
+#define TID_INITIAL_CAPACITY 64
+
+typedef struct {
+  l1_tid tid;                   /** Thread ID */
+  l1_thread_info* thread;       /** Thread, NULL if the entry is empty */
+} l1_tid_entry;
+
+typedef struct {
+  l1_tid_entry* entries;        /** Hash table, linear probing */
+  size_t capacity;              /** Number of entries, a power of two */
+  size_t size;                  /** Number of threads in the table */
+  l1_tid* free_tids;            /** FIFO ring of released IDs */
+  size_t free_head;             /** Oldest released ID */
+  size_t free_count;            /** Number of released IDs */
+  size_t free_capacity;         /** Size of the free_tids ring */
+  l1_tid next_index;            /** Next index never used */
+} l1_tid_table;
+
+/**
+ * @brief Returns an ID which no live thread has, or -1 if there is none left
+ */
+l1_tid tid_table_alloc(l1_tid_table* table);
+
+/**
+ * @brief Makes the ID of a thread which is not in the table reusable
+ *
+ * The next thread with the same index gets the next generation.
+ */
+void tid_table_release(l1_tid_table* table, l1_tid tid);
+
+/**
+ * @brief Indexes thread by its ID
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code.
+ */
+l1_error tid_table_insert(l1_tid_table* table, l1_thread_info* thread);
+
+/**
+ * @brief Returns the thread with ID tid, NULL if there is none
+ */
+l1_thread_info* tid_table_find(l1_tid_table* table, l1_tid tid);
+
+/**
+ * @brief Removes the thread with ID tid from the table, if it is there
+ */
+void tid_table_remove(l1_tid_table* table, l1_tid tid);
+
+/**
+ * @brief Frees the memory of the table
+ */
+void tid_table_free(l1_tid_table* table);
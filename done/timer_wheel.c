@@ -0,0 +1,141 @@
+/**
+ * @file timer_wheel.c
+ * @brief Implementation of the hierarchical timer wheel
+ */
+#include <string.h>
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+/* Ticks covered by the levels below level */
+#define LEVEL_SPAN(level) (1ULL << (TIMER_WHEEL_SLOT_BITS * (level)))
+
+void timer_wheel_init(l1_timer_wheel* wheel, uint64_t now) {
+  memset(wheel, 0, sizeof(l1_timer_wheel));
+  wheel->next_tick = now >> TIMER_WHEEL_TICK_SHIFT;
+}
+
+static void slot_push(l1_thread_info** slot, l1_thread_info* thread) {
+  thread->timer_prev = NULL;
+  thread->timer_next = *slot;
+  if (*slot) {
+    (*slot)->timer_prev = thread;
+  }
+  *slot = thread;
+  thread->timer_slot = slot;
+}
+
+/* Puts the thread in the slot of its tick, relative to next_tick */
+static void wheel_place(l1_timer_wheel* wheel, l1_thread_info* thread) {
+  uint64_t tick = thread->timer_tick;
+  int level = 0;
+
+  if (tick < wheel->next_tick) {
+    tick = wheel->next_tick;
+  }
+  uint64_t delta = tick - wheel->next_tick;
+  if (delta >= LEVEL_SPAN(TIMER_WHEEL_LEVELS)) {
+    /* Placed again when the furthest slot cascades */
+    delta = LEVEL_SPAN(TIMER_WHEEL_LEVELS) - 1;
+    tick = wheel->next_tick + delta;
+  }
+  while (delta >= LEVEL_SPAN(level + 1)) {
+    level++;
+  }
+  int slot = (tick >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+  slot_push(&wheel->slots[level][slot], thread);
+}
+
+void timer_wheel_add(l1_timer_wheel* wheel, l1_thread_info* thread, uint64_t deadline) {
+  /* First tick entirely past the deadline */
+  thread->timer_tick = (deadline >> TIMER_WHEEL_TICK_SHIFT) + 1;
+  wheel_place(wheel, thread);
+  wheel->count++;
+}
+
+void timer_wheel_remove(l1_timer_wheel* wheel, l1_thread_info* thread) {
+  if (!thread->timer_slot) {
+    return;
+  }
+  if (thread->timer_prev) {
+    thread->timer_prev->timer_next = thread->timer_next;
+  } else {
+    *thread->timer_slot = thread->timer_next;
+  }
+  if (thread->timer_next) {
+    thread->timer_next->timer_prev = thread->timer_prev;
+  }
+  thread->timer_prev = thread->timer_next = NULL;
+  thread->timer_slot = NULL;
+  wheel->count--;
+}
+
+/* Moves the threads of a slot to the levels below */
+static void wheel_cascade(l1_timer_wheel* wheel, int level, int slot) {
+  l1_thread_info* thread = wheel->slots[level][slot];
+
+  wheel->slots[level][slot] = NULL;
+  while (thread) {
+    l1_thread_info* next = thread->timer_next;
+    wheel_place(wheel, thread);
+    thread = next;
+  }
+}
+
+size_t timer_wheel_advance(l1_timer_wheel* wheel, uint64_t now,
+                           void (*expire)(l1_thread_info*)) {
+  uint64_t last = now >> TIMER_WHEEL_TICK_SHIFT;
+  size_t expired = 0;
+
+  while (wheel->next_tick <= last) {
+    if (wheel->count == 0) {
+      wheel->next_tick = last + 1;
+      break;
+    }
+    uint64_t tick = wheel->next_tick;
+    /* Cascade each level whose slot starts at this tick */
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+      if (tick & (LEVEL_SPAN(level) - 1)) {
+        break;
+      }
+      wheel_cascade(wheel, level, (tick >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+    }
+
+    l1_thread_info* thread = wheel->slots[0][tick & SLOT_MASK];
+    wheel->slots[0][tick & SLOT_MASK] = NULL;
+    wheel->next_tick++;
+    while (thread) {
+      l1_thread_info* next = thread->timer_next;
+      thread->timer_prev = thread->timer_next = NULL;
+      thread->timer_slot = NULL;
+      wheel->count--;
+      expire(thread);
+      expired++;
+      thread = next;
+    }
+  }
+  return expired;
+}
+
+uint64_t timer_wheel_next(l1_timer_wheel* wheel) {
+  uint64_t first = TIMER_WHEEL_NONE;
+
+  if (wheel->count == 0) {
+    return TIMER_WHEEL_NONE;
+  }
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+    uint64_t base = wheel->next_tick >> (TIMER_WHEEL_SLOT_BITS * level);
+
+    /* The slot of base is either due now or a whole turn away */
+    for (uint64_t i = 0; i <= TIMER_WHEEL_SLOTS; ++i) {
+      uint64_t start = (base + i) << (TIMER_WHEEL_SLOT_BITS * level);
+
+      if (start >= wheel->next_tick && wheel->slots[level][(base + i) & SLOT_MASK]) {
+        if (start < first) {
+          first = start;
+        }
+        break;
+      }
+    }
+  }
+  return first << TIMER_WHEEL_TICK_SHIFT;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel of threads waiting for a deadline
+ *
+ * Time is cut in ticks of 2^TIMER_WHEEL_TICK_SHIFT ns. Level 0 has one slot
+ * per tick for the next TIMER_WHEEL_SLOTS ticks, and each level above has
+ * slots TIMER_WHEEL_SLOTS times as long. When the wheel reaches a slot of
+ * a higher level, its threads cascade into the lower levels, so adding and
+ * removing a thread are O(1). Deadlines beyond the last level wait in its
+ * furthest slot and are placed again when it cascades.
+ *
+ * A thread expires on the first tick which is entirely past its deadline,
+ * so never early, and at most one tick late once the wheel is advanced.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_info.h"
+
+#define TIMER_WHEEL_TICK_SHIFT 16     /* 65.5 us */
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS 6
+/* Returned by timer_wheel_next when the wheel is empty */
+#define TIMER_WHEEL_NONE UINT64_MAX
+
+typedef struct {
+  l1_thread_info* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  /** Threads, by expiry */
+  uint64_t next_tick;           /** Next tick to expire */
+  size_t count;                 /** Number of threads in the wheel */
+} l1_timer_wheel;
+
+/**
+ * @brief Initializes an empty wheel, starting at time now (ns)
+ */
+void timer_wheel_init(l1_timer_wheel* wheel, uint64_t now);
+
+/**
+ * @brief Adds a thread which expires at deadline (ns)
+ *
+ * @warning The thread must not be in the wheel already.
+ */
+void timer_wheel_add(l1_timer_wheel* wheel, l1_thread_info* thread, uint64_t deadline);
+
+/**
+ * @brief Removes a thread from the wheel, if it is in it
+ */
+void timer_wheel_remove(l1_timer_wheel* wheel, l1_thread_info* thread);
+
+/**
+ * @brief Removes the threads whose deadline passed at time now (ns), and
+ * calls expire for each of them
+ *
+ * @return The number of threads which expired
+ */
+size_t timer_wheel_advance(l1_timer_wheel* wheel, uint64_t now,
+                           void (*expire)(l1_thread_info*));
+
+/**
+ * @brief Returns a time (ns) no later than the first deadline in the wheel,
+ * TIMER_WHEEL_NONE if it is empty
+ *
+ * The time is the start of the slot holding the first deadline, so
+ * advancing the wheel then may only cascade threads rather than expire them.
+ */
+uint64_t timer_wheel_next(l1_timer_wheel* wheel);
@@ -0,0 +1,181 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the ring of trace events and its JSON export
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "l1_time.h"
+#include "schedule.h"
+#include "trace.h"
+
+/* Track of a thread in the JSON trace, tsys (-1) is 0 */
+#define TRACE_TRACK(tid) ((uint32_t)((tid) + 1))
+
+static const char* state_names[NUM_THREAD_STATES] = {
+  "RUNNING", "RUNNABLE", "BLOCKED", "ZOMBIE", "DEAD", "IO_WAIT", "SLEEPING", "WAITING",
+};
+
+static const char* pick_names[] = { "policy", "yield", "edf" };
+
+l1_error l1_trace_start(size_t capacity) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  if (!sched_info || sched_info->worker || sched_info->trace || capacity == 0) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_trace_start(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  /* The slot the writer is filling is not readable */
+  uint64_t size = 2;
+  while (size < capacity + 1) size <<= 1;
+
+  l1_trace_ring* ring = malloc(sizeof(l1_trace_ring));
+  if (ring) {
+    ring->events = malloc(size * sizeof(l1_trace_event));
+  }
+  if (!ring || !ring->events) {
+    free(ring);
+    l1_errno = ERRNOMEM;
+    fprintf(stderr, "l1_trace_start(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  ring->mask = size - 1;
+  atomic_init(&ring->head, 0);
+  sched_info->trace = ring;
+  return SUCCESS;
+}
+
+void l1_trace_stop(void) {
+  l1_scheduler_info* sched_info = get_scheduler();
+
+  if (!sched_info || !sched_info->trace) {
+    return;
+  }
+  free(sched_info->trace->events);
+  free(sched_info->trace);
+  sched_info->trace = NULL;
+}
+
+void l1_trace_emit(l1_trace_ring* ring, l1_trace_type type, l1_tid tid,
+                   l1_tid arg, int from, int to) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  l1_trace_event* event = &ring->events[head & ring->mask];
+
+  /* Keeps the event from being written before head reaches it, so readers
+   * which see part of it also see head there, see l1_trace_read */
+  atomic_thread_fence(memory_order_release);
+  l1_time_get(&event->time);
+  event->tid = tid;
+  event->arg = arg;
+  event->type = type;
+  event->from = from;
+  event->to = to;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+size_t l1_trace_read(l1_trace_ring* ring, l1_trace_event* events, size_t max) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint64_t first = head > ring->mask ? head - ring->mask : 0;
+
+  if (head - first > max) first = head - max;
+  for (uint64_t i = first; i < head; ++i)
+    events[i - first] = ring->events[i & ring->mask];
+
+  /* The writer may have overwritten the oldest events meanwhile, and be
+   * writing the one at the new head, over the one mask events before */
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t end = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint64_t valid = end > ring->mask ? end - ring->mask : 0;
+
+  if (valid <= first) {
+    return head - first;
+  }
+  if (valid >= head) {
+    return 0;
+  }
+  for (uint64_t i = valid; i < head; ++i)
+    events[i - valid] = events[i - first];
+  return head - valid;
+}
+
+/* Writes the running slice of track from start to end. Events follow the
+ * tsys metadata, so they start with a comma. */
+static void write_slice(FILE* out, uint32_t track, uint64_t start,
+                        uint64_t end, uint64_t base) {
+  fprintf(out, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"running\"}",
+          track, (start - base) / 1e3, (end - start) / 1e3);
+}
+
+/* Writes an instant event of track, whose args are in args */
+static void write_instant(FILE* out, uint32_t track, uint64_t time,
+                          uint64_t base, const char* name, const char* args) {
+  fprintf(out, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\",\"args\":{%s}}",
+          track, (time - base) / 1e3, name, args);
+}
+
+static const char* state_name(int state) {
+  return state < NUM_THREAD_STATES ? state_names[state] : "SYSTHREAD";
+}
+
+l1_error l1_trace_write_json(const l1_trace_event* events, size_t count, FILE* out) {
+  uint64_t base = count > 0 ? events[0].time : 0;
+  /* Only one thread of a scheduler runs at a time */
+  bool running = false;
+  uint32_t running_track = 0;
+  uint64_t running_start = 0;
+  char args[128];
+
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fprintf(out, "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"thread_name\",\"args\":{\"name\":\"tsys\"}}");
+  for (size_t i = 0; i < count; ++i) {
+    const l1_trace_event* event = &events[i];
+    uint32_t track = TRACE_TRACK(event->tid);
+
+    switch (event->type) {
+    case L1_TRACE_CREATE:
+      fprintf(out, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"thread %d\"}}",
+              track, (int32_t)event->tid);
+      snprintf(args, sizeof(args), "\"state\":\"%s\"", state_name(event->to));
+      write_instant(out, track, event->time, base, "create", args);
+      break;
+    case L1_TRACE_SWITCH:
+      if (running) {
+        write_slice(out, running_track, running_start, event->time, base);
+      }
+      running = true;
+      running_track = track;
+      running_start = event->time;
+      break;
+    case L1_TRACE_STATE:
+      if (running && running_track == track && event->from == RUNNING) {
+        write_slice(out, running_track, running_start, event->time, base);
+        running = false;
+      }
+      snprintf(args, sizeof(args), "\"from\":\"%s\"", state_name(event->from));
+      write_instant(out, track, event->time, base, state_name(event->to), args);
+      break;
+    case L1_TRACE_JOIN:
+      snprintf(args, sizeof(args), "\"target\":%d", (int32_t)event->arg);
+      write_instant(out, track, event->time, base, "join", args);
+      break;
+    case L1_TRACE_PICK:
+      snprintf(args, sizeof(args), "\"reason\":\"%s\",\"prev\":%d",
+               event->from <= L1_TRACE_PICK_EDF ? pick_names[event->from] : "?",
+               (int32_t)event->arg);
+      write_instant(out, track, event->time, base, "pick", args);
+      break;
+    }
+  }
+  if (running) {
+    write_slice(out, running_track, running_start, events[count - 1].time, base);
+  }
+  fprintf(out, "\n]}\n");
+
+  if (ferror(out)) {
+    l1_errno = ERRINVAL;
+    fprintf(stderr, "l1_trace_write_json(): errno %d %s\n", l1_errno, l1_strerror(l1_errno));
+    return l1_errno;
+  }
+  return SUCCESS;
+}
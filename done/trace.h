@@ -0,0 +1,114 @@
+/**
+ * @file trace.h
+ * @brief Binary trace of the scheduler's events, exported for Perfetto
+ *
+ * Once started, the scheduler records its creates, switches, state
+ * transitions, joins and policy picks in a ring of fixed-size events. When
+ * the ring is full, each event overwrites the oldest one, so it keeps at
+ * least the last `capacity` events. The scheduler's OS thread is the only
+ * writer and never waits: it publishes each event by advancing the ring's
+ * head, and readers on any OS thread copy the events, then drop those the
+ * writer overwrote meanwhile.
+ *
+ * With tracing off, each trace point is one branch on the scheduler's
+ * `trace` pointer, which stays NULL.
+ *
+ * `l1_trace_write_json` converts events to the Chrome JSON trace format,
+ * which Perfetto (ui.perfetto.dev) and chrome://tracing load: each thread is
+ * a track with its running slices, and the other events are instants on it.
+ *
+ * Tracing is not available in M:N mode.
+ */
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "error.h"
+#include "thread_info.h"
+
+typedef enum {
+  L1_TRACE_CREATE,      /* tid was added to the scheduler in state `to` */
+  L1_TRACE_STATE,       /* tid went from state `from` to state `to` */
+  L1_TRACE_SWITCH,      /* The scheduler switched from arg to tid */
+  L1_TRACE_JOIN,        /* tid waits for arg to finish */
+  L1_TRACE_PICK,        /* tid was picked to run after arg, for reason `from` */
+  L1_TRACE_NUM_TYPES
+} l1_trace_type;
+
+/* Reasons of L1_TRACE_PICK */
+typedef enum {
+  L1_TRACE_PICK_POLICY, /* The policy's choice */
+  L1_TRACE_PICK_YIELD,  /* The target of the previous thread's yield */
+  L1_TRACE_PICK_EDF,    /* The earliest deadline, ahead of the policy */
+} l1_trace_pick;
+
+typedef struct {
+  uint64_t time;        /** l1_time of the event, in ns */
+  l1_tid tid;           /** Thread the event is about, -1 for tsys */
+  l1_tid arg;           /** Other thread of the event, -1 if none */
+  uint8_t type;         /** l1_trace_type */
+  uint8_t from;         /** STATE: previous state, PICK: l1_trace_pick */
+  uint8_t to;           /** CREATE, STATE: new state */
+} l1_trace_event;
+
+typedef struct {
+  l1_trace_event* events;       /** Circular buffer */
+  uint64_t mask;                /** Slots - 1, slots are a power of two */
+  _Atomic uint64_t head;        /** Events written so far */
+} l1_trace_ring;
+
+/* Records an event if ring is not NULL. The branch is the whole cost of a
+ * trace point when tracing is off. */
+#define L1_TRACE(ring, type, tid, arg, from, to)                          \
+  do {                                                                    \
+    if (__builtin_expect((ring) != NULL, 0))                              \
+      l1_trace_emit((ring), (type), (tid), (arg), (from), (to));          \
+  } while (0)
+
+/**
+ * @brief Starts recording the events of the scheduler of the calling OS
+ * thread
+ *
+ * @param  capacity  Number of events kept, rounded up to a power of two
+ *                   minus one: the slot being written is not readable
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ *          ERRINVAL without a scheduler, in M:N mode, for a capacity of 0 or
+ *          if already started; ERRNOMEM if the ring cannot be allocated
+ */
+l1_error l1_trace_start(size_t capacity);
+
+/**
+ * @brief Stops recording and frees the events of the scheduler of the
+ * calling OS thread
+ */
+void l1_trace_stop(void);
+
+/**
+ * @brief Appends an event to the ring, for L1_TRACE
+ *
+ * @warning Only the scheduler's OS thread may write to its ring.
+ */
+void l1_trace_emit(l1_trace_ring* ring, l1_trace_type type, l1_tid tid,
+                   l1_tid arg, int from, int to);
+
+/**
+ * @brief Copies the last events of a ring, oldest first
+ *
+ * Safe from any OS thread while the scheduler writes to the ring.
+ *
+ * @param  events  Array of at least max events
+ * @return  The number of events copied
+ */
+size_t l1_trace_read(l1_trace_ring* ring, l1_trace_event* events, size_t max);
+
+/**
+ * @brief Writes events, oldest first, as a Chrome JSON trace
+ *
+ * Thread t is track t + 1 and tsys is track 0. A thread runs from the
+ * switch to it until it leaves RUNNING or the next switch.
+ *
+ * @return  If successful, return SUCCESS. On error, it returns an error code:
+ *          ERRINVAL if writing to out failed
+ */
+l1_error l1_trace_write_json(const l1_trace_event* events, size_t count, FILE* out);
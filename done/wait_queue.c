@@ -0,0 +1,44 @@
+/**
+ * @file wait_queue.c
+ * @brief Implementation of the queues of blocked threads
+ */
+#include <stddef.h>
+#include "wait_queue.h"
+
+void wait_queue_add(l1_wait_queue* queue, l1_thread_info* thread) {
+  thread->wait_next = NULL;
+  thread->wait_prev = queue->tail;
+  if (queue->tail) {
+    queue->tail->wait_next = thread;
+  } else {
+    queue->head = thread;
+  }
+  queue->tail = thread;
+}
+
+void wait_queue_remove(l1_wait_queue* queue, l1_thread_info* thread) {
+  if (thread->wait_prev) {
+    thread->wait_prev->wait_next = thread->wait_next;
+  } else {
+    queue->head = thread->wait_next;
+  }
+  if (thread->wait_next) {
+    thread->wait_next->wait_prev = thread->wait_prev;
+  } else {
+    queue->tail = thread->wait_prev;
+  }
+  thread->wait_prev = thread->wait_next = NULL;
+}
+
+l1_thread_info* wait_queue_pop(l1_wait_queue* queue) {
+  l1_thread_info* thread = queue->head;
+
+  if (thread) {
+    wait_queue_remove(queue, thread);
+  }
+  return thread;
+}
+
+bool wait_queue_is_empty(l1_wait_queue* queue) {
+  return queue->head == NULL;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file wait_queue.h
+ * @brief FIFO queues of blocked threads
+ *
+ * A blocked thread waits on one thing at a time, so all wait queues link
+ * threads through the same wait_prev and wait_next fields. The queue type
+ * is defined in thread_info.h, since threads have one for their joiners.
+ */
+#pragma once
+#include <stdbool.h>
+#include "thread_info.h"
+
+/**
+ * @brief Appends a thread to the queue
+ */
+void wait_queue_add(l1_wait_queue* queue, l1_thread_info* thread);
+
+/**
+ * @brief Removes a thread from the queue
+ * @warning The function does not check that thread is in queue.
+ */
+void wait_queue_remove(l1_wait_queue* queue, l1_thread_info* thread);
+
+/**
+ * @brief Removes and returns the head of the queue, NULL if it is empty
+ */
+l1_thread_info* wait_queue_pop(l1_wait_queue* queue);
+
+/**
+ * @brief Check if the queue is empty
+ */
+bool wait_queue_is_empty(l1_wait_queue* queue);